@@ -1,6 +1,7 @@
 #pragma once
-#include <stdint.h>
+#include "types.h"
 #include "bitmap.h"
+#include "debug.h"
 
 #define ALLOCATOR_SIZE 256
 
@@ -13,5 +14,32 @@ typedef struct { \
 int TYPENAME##_alloc(TYPENAME##_allocator *a); \
 int TYPENAME##_dealloc(TYPENAME##_allocator *a, uint8_t idx);
 
+// Macro to implement a generic bitmap-based allocator for any type.
+// Put exactly one DEFINE_ALLOCATOR_TYPE per type in a .c file, next to its users.
+// SIZE must not exceed ALLOCATOR_SIZE (one bitmap256 tracks the slots).
+#define DEFINE_ALLOCATOR_TYPE(TYPENAME, TYPE, SIZE) \
+_Static_assert((SIZE) <= ALLOCATOR_SIZE, #TYPENAME " allocator exceeds bitmap size"); \
+int TYPENAME##_alloc(TYPENAME##_allocator *a) { \
+    int idx = bitmap_first_zero(&a->used); \
+    if (idx == -1 || idx >= (SIZE)) { \
+        klog_error(#TYPENAME "_alloc: out of slots"); \
+        return -1; \
+    } \
+    bitmap_set(&a->used, (uint8_t)idx); \
+    return idx; \
+} \
+int TYPENAME##_dealloc(TYPENAME##_allocator *a, uint8_t idx) { \
+    if (idx >= (SIZE)) { \
+        klog_error(#TYPENAME "_dealloc: invalid index"); \
+        return -1; \
+    } \
+    if (!bitmap_get(&a->used, idx)) { \
+        klog_error(#TYPENAME "_dealloc: index not allocated"); \
+        return -1; \
+    } \
+    bitmap_clear(&a->used, idx); \
+    return 0; \
+}
+
 // Declare a uint8_t allocator with 256 slots
 DECLARE_ALLOCATOR_TYPE(uint8, uint8_t, ALLOCATOR_SIZE)
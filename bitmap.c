@@ -1,11 +1,21 @@
 #include "bitmap.h"
-#include "math.h"
+
+#define ALL_WORDS ((1U << BITMAP_SIZE) - 1)
+
 void bitmap_set(bitmap256 *bm, uint16_t idx) {
-    bm->bits[idx / 32] |= (1U << (idx % 32));
-    sqrt(10);
+    uint32_t word = idx / 32;
+    bm->bits[word] |= (1U << (idx % 32));
+    bm->nonempty |= (1U << word);
+    if (bm->bits[word] == 0xFFFFFFFFU)
+        bm->full |= (1U << word);
 }
+
 void bitmap_clear(bitmap256 *bm, uint16_t idx) {
-    bm->bits[idx / 32] &= ~(1U << (idx % 32));
+    uint32_t word = idx / 32;
+    bm->bits[word] &= ~(1U << (idx % 32));
+    bm->full &= ~(1U << word);
+    if (bm->bits[word] == 0)
+        bm->nonempty &= ~(1U << word);
 }
 
 int bitmap_get(bitmap256 *bm, uint16_t idx) {
@@ -13,23 +23,16 @@ int bitmap_get(bitmap256 *bm, uint16_t idx) {
 }
 
 int bitmap_first_zero(bitmap256 *bm) {
-    for (int i = 0; i < BITMAP_SIZE; ++i) {
-        if (bm->bits[i] != 0xFFFFFFFFU) {
-            int bit = __builtin_ffs(~bm->bits[i]);
-            if (bit)
-                return i * 32 + (bit - 1);
-        }
-    }
-    return -1;
+    uint32_t open = ~bm->full & ALL_WORDS;
+    if (open == 0)
+        return -1;
+    int word = __builtin_ctz(open);
+    return word * 32 + __builtin_ctz(~bm->bits[word]);
 }
 
 int bitmap_first_one(bitmap256 *bm) {
-    for (int i = 0; i < BITMAP_SIZE; ++i) {
-        if (bm->bits[i] != 0) {
-            int bit = __builtin_ffs(bm->bits[i]);
-            if (bit)
-                return i * 32 + (bit - 1);
-        }
-    }
-    return -1;
+    if (bm->nonempty == 0)
+        return -1;
+    int word = __builtin_ctz(bm->nonempty);
+    return word * 32 + __builtin_ctz(bm->bits[word]);
 }
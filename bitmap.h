@@ -1,10 +1,14 @@
 #pragma once
-#include <stdint.h>
+#include "types.h"
 
 #define BITMAP_SIZE 8 // 8 * 32 = 256 bits
 
+// Two-level bitmap: each summary word keeps one bit per data word, so the searches look
+// at two words whatever the fill. A zero-initialized bitmap256 is empty.
 typedef struct {
     uint32_t bits[BITMAP_SIZE];
+    uint32_t full;     // Bit i set when bits[i] is all ones
+    uint32_t nonempty; // Bit i set when bits[i] has any bit set
 } bitmap256;
 
 // Set the bit at index (0..255)
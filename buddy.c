@@ -0,0 +1,216 @@
+#include "buddy.h"
+#include "debug.h"
+#include "system.h"
+
+// Free blocks are linked through their own first bytes (physical memory is identity mapped).
+// Every process shares these lists, so the public calls run with interrupts disabled; each is
+// at most BUDDY_MAX_ORDER split or merge steps.
+struct buddy_block {
+    struct buddy_block* next;
+    struct buddy_block* prev;
+};
+
+// One state byte per page. Only the first page of a free block is marked:
+// BUDDY_FREE | order. Every other page (allocated, or inside a free block) is 0.
+#define BUDDY_FREE 0x80
+
+static uint8_t* page_state = NULL;
+static uintptr_t base_pfn = 0;
+static size_t page_count = 0;
+static size_t free_pages = 0;
+
+static struct buddy_block* free_lists[BUDDY_MAX_ORDER + 1];
+static uint32_t order_bitmap = 0; // Bit k set when free_lists[k] is non-empty
+
+static inline uintptr_t pfn_of(const void* ptr) {
+    return (uintptr_t)ptr >> PAGE_SHIFT;
+}
+
+static inline void* pfn_addr(uintptr_t pfn) {
+    return (void*)(pfn << PAGE_SHIFT);
+}
+
+static inline int pfn_valid(uintptr_t pfn) {
+    return pfn >= base_pfn && pfn - base_pfn < page_count;
+}
+
+static void list_push(unsigned int order, uintptr_t pfn) {
+    struct buddy_block* block = (struct buddy_block*)pfn_addr(pfn);
+    block->prev = NULL;
+    block->next = free_lists[order];
+    if (block->next) block->next->prev = block;
+    free_lists[order] = block;
+    order_bitmap |= (1U << order);
+    page_state[pfn - base_pfn] = BUDDY_FREE | order;
+}
+
+static void list_remove(unsigned int order, uintptr_t pfn) {
+    struct buddy_block* block = (struct buddy_block*)pfn_addr(pfn);
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        free_lists[order] = block->next;
+    }
+    if (block->next) block->next->prev = block->prev;
+    if (free_lists[order] == NULL) order_bitmap &= ~(1U << order);
+    page_state[pfn - base_pfn] = 0;
+}
+
+// Put a block back, merging with its buddy for as long as the buddy is free and whole.
+static void block_free(uintptr_t pfn, unsigned int order) {
+    while (order < BUDDY_MAX_ORDER) {
+        uintptr_t buddy = pfn ^ ((uintptr_t)1 << order);
+        if (!pfn_valid(buddy) || page_state[buddy - base_pfn] != (BUDDY_FREE | order)) {
+            break;
+        }
+        list_remove(order, buddy);
+        pfn &= ~((uintptr_t)1 << order);
+        order++;
+    }
+    list_push(order, pfn);
+}
+
+// Free an arbitrary run by splitting it into the largest naturally aligned blocks.
+static void range_free(uintptr_t pfn, size_t count) {
+    while (count > 0) {
+        unsigned int order = 0;
+        while (order < BUDDY_MAX_ORDER &&
+               (pfn & ((uintptr_t)1 << order)) == 0 &&
+               ((size_t)2 << order) <= count) {
+            order++;
+        }
+        block_free(pfn, order);
+        pfn += (uintptr_t)1 << order;
+        count -= (size_t)1 << order;
+    }
+}
+
+void buddy_init(uintptr_t start, uintptr_t end) {
+    start = (start + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+    end &= ~(uintptr_t)(PAGE_SIZE - 1);
+
+    for (int i = 0; i <= BUDDY_MAX_ORDER; i++) {
+        free_lists[i] = NULL;
+    }
+    order_bitmap = 0;
+    free_pages = 0;
+    base_pfn = pfn_of((void*)start);
+    page_count = (end > start) ? (end - start) >> PAGE_SHIFT : 0;
+
+    // The state table lives in the first pages of the range and is never freed
+    size_t table_pages = (page_count + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    if (table_pages >= page_count) {
+        page_count = 0;
+        return;
+    }
+    page_state = (uint8_t*)start;
+    for (size_t i = 0; i < page_count; i++) {
+        page_state[i] = 0;
+    }
+
+    range_free(base_pfn + table_pages, page_count - table_pages);
+    free_pages = page_count - table_pages;
+
+    kdebug_puts("[BUDDY] Managing ");
+    kdebug_puthex(free_pages);
+    kdebug_puts(" pages above the kernel\n");
+}
+
+int buddy_order_for(size_t count) {
+    int order = 0;
+    while (((size_t)1 << order) < count) {
+        if (++order > BUDDY_MAX_ORDER) return -1;
+    }
+    return order;
+}
+
+// Take a 2^order block off the free lists. Caller has interrupts disabled.
+static void* block_alloc(unsigned int order) {
+    uint32_t usable = order_bitmap & ~((1U << order) - 1);
+    if (usable == 0) {
+        return NULL;
+    }
+
+    // Smallest non-empty order that fits, then split down, keeping the upper halves free
+    unsigned int k = (unsigned int)__builtin_ctz(usable);
+    uintptr_t pfn = pfn_of(free_lists[k]);
+    list_remove(k, pfn);
+    while (k > order) {
+        k--;
+        list_push(k, pfn + ((uintptr_t)1 << k));
+    }
+
+    free_pages -= (size_t)1 << order;
+    return pfn_addr(pfn);
+}
+
+void* buddy_alloc(unsigned int order) {
+    if (order > BUDDY_MAX_ORDER) {
+        return NULL;
+    }
+    uintptr_t flags = irq_save();
+    void* mem = block_alloc(order);
+    irq_restore(flags);
+    return mem;
+}
+
+// Check that [ptr, ptr + count pages) is managed and does not start inside the free lists.
+static int range_check(const void* ptr, size_t count, const char* who) {
+    uintptr_t pfn = pfn_of(ptr);
+    if (((uintptr_t)ptr & (PAGE_SIZE - 1)) != 0 || !pfn_valid(pfn) ||
+        count == 0 || count > page_count - (pfn - base_pfn)) {
+        klog_error(who);
+        return -1;
+    }
+    if (page_state[pfn - base_pfn] & BUDDY_FREE) {
+        klog_error("buddy: block already free");
+        return -2;
+    }
+    return 0;
+}
+
+int buddy_free(void* ptr, unsigned int order) {
+    if (order > BUDDY_MAX_ORDER || (pfn_of(ptr) & (((uintptr_t)1 << order) - 1)) != 0) {
+        klog_error("buddy_free: bad order or misaligned block");
+        return -1;
+    }
+    uintptr_t flags = irq_save();
+    int err = range_check(ptr, (size_t)1 << order, "buddy_free: block outside managed memory");
+    if (err == 0) {
+        block_free(pfn_of(ptr), order);
+        free_pages += (size_t)1 << order;
+    }
+    irq_restore(flags);
+    return err;
+}
+
+void* buddy_alloc_pages(size_t count) {
+    int order = buddy_order_for(count);
+    if (count == 0 || order < 0) {
+        return NULL;
+    }
+    uintptr_t flags = irq_save();
+    uint8_t* mem = (uint8_t*)block_alloc((unsigned int)order);
+    size_t tail = ((size_t)1 << order) - count;
+    if (mem != NULL && tail > 0) {
+        range_free(pfn_of(mem) + count, tail);
+        free_pages += tail;
+    }
+    irq_restore(flags);
+    return mem;
+}
+
+int buddy_free_pages(void* ptr, size_t count) {
+    uintptr_t flags = irq_save();
+    int err = range_check(ptr, count, "buddy_free_pages: run outside managed memory");
+    if (err == 0) {
+        range_free(pfn_of(ptr), count);
+        free_pages += count;
+    }
+    irq_restore(flags);
+    return err;
+}
+
+size_t buddy_free_bytes(void) {
+    return free_pages * PAGE_SIZE;
+}
@@ -0,0 +1,40 @@
+#ifndef MEMORY_BUDDY_H
+#define MEMORY_BUDDY_H
+
+#include "types.h"
+
+// Binary buddy allocator for physical page frames.
+// Blocks are 2^order pages (order 0 = one 4KB page, BUDDY_MAX_ORDER = 4MB) and are aligned
+// to their own size, so a block's buddy is found by flipping one bit of its frame number.
+// Allocation splits the smallest large-enough free block; freeing merges with free buddies.
+#define PAGE_SIZE 4096
+#define PAGE_SHIFT 12
+#define BUDDY_MAX_ORDER 10
+
+// Manage the physical range [start, end). Called once at boot.
+// The per-page state table is carved from the start of the range.
+void buddy_init(uintptr_t start, uintptr_t end);
+
+// Allocate 2^order contiguous pages, aligned to 2^order pages.
+// Returns NULL if no block of that order can be formed.
+void* buddy_alloc(unsigned int order);
+
+// Return a block obtained from buddy_alloc with the same order.
+// Returns 0 on success, negative on error.
+int buddy_free(void* ptr, unsigned int order);
+
+// Allocate exactly `count` contiguous pages; the tail of the rounded-up block is given back.
+// The run is aligned to `count` rounded up to a power of two pages.
+void* buddy_alloc_pages(size_t count);
+
+// Return `count` pages starting at ptr (from buddy_alloc_pages, or any allocated run).
+// Returns 0 on success, negative on error.
+int buddy_free_pages(void* ptr, size_t count);
+
+// Smallest order whose block holds `count` pages, or -1 if above BUDDY_MAX_ORDER.
+int buddy_order_for(size_t count);
+
+// Bytes currently free.
+size_t buddy_free_bytes(void);
+
+#endif // MEMORY_BUDDY_H
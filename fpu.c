@@ -0,0 +1,130 @@
+#include "fpu.h"
+#include "debug.h"
+#include "idt.h"
+#include "process.h"
+#include "slab.h"
+#include "string.h"
+
+#define CR0_MP (1U << 1)  // WAIT honours TS
+#define CR0_EM (1U << 2)  // Emulate FPU: must be clear for SSE
+#define CR0_TS (1U << 3)  // Task switched: next FPU instruction raises #NM
+#define CR0_NE (1U << 5)  // Report x87 errors as #MF, not through the PIC
+#define CR4_OSFXSR (1U << 9)
+#define CR4_OSXMMEXCPT (1U << 10)
+#define CPUID_FXSR (1U << 24)
+#define CPUID_SSE (1U << 25)
+#define MXCSR_DEFAULT 0x1F80 // All SSE exceptions masked, round to nearest
+
+extern void fpu_nm_stub(void);
+
+static int fpu_ready = 0;
+static uint8_t fpu_owner = 255; // Process whose state is in the FPU registers, or none
+static int ts_set = 0;          // Copy of CR0.TS, so switches only write CR0 when it changes
+static struct slab_cache *fpu_cache = NULL;
+static uint8_t fpu_clean[FPU_STATE_SIZE] __attribute__((aligned(16))); // After fninit
+
+static inline uintptr_t read_cr0(void) {
+    uintptr_t v;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr0(uintptr_t v) {
+    __asm__ volatile("mov %0, %%cr0" : : "r"(v));
+}
+
+static inline void set_ts(int on) {
+    if (on) {
+        write_cr0(read_cr0() | CR0_TS);
+    } else {
+        __asm__ volatile("clts");
+    }
+    ts_set = on;
+}
+
+void fpu_init(void) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if ((edx & (CPUID_FXSR | CPUID_SSE)) != (CPUID_FXSR | CPUID_SSE)) {
+        klog_error("fpu_init: CPU lacks FXSR/SSE, FPU state not switched");
+        return;
+    }
+    fpu_cache = slab_cache_create("fpu", FPU_STATE_SIZE, 16, NULL);
+    if (!fpu_cache) {
+        klog_error("fpu_init: cannot create the FPU state cache");
+        return;
+    }
+
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+    uintptr_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4 | CR4_OSFXSR | CR4_OSXMMEXCPT));
+
+    // The state every process starts from
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    __asm__ volatile("fninit\n\tldmxcsr %0" : : "m"(mxcsr));
+    __asm__ volatile("fxsave %0" : "=m"(fpu_clean));
+
+    idt_set_gate(7, (uint32_t)(uintptr_t)fpu_nm_stub, 0x08, 0x8E); // #NM: device not available
+    set_ts(1);
+    fpu_ready = 1;
+    kdebug_puts("[FPU] SSE enabled, lazy switching on\n");
+}
+
+void fpu_switch(uint8_t next_pid) {
+    if (!fpu_ready) return;
+    int want = next_pid != fpu_owner;
+    if (want != ts_set) {
+        set_ts(want);
+    }
+}
+
+// Copy an fxsave area with integer moves only. The #NM handler runs with CR0.TS clear and
+// the previous owner's registers still live, so it must not go through an SSE memcpy.
+static void fpu_copy(void *dest, const void *src) {
+    uint32_t *d = dest;
+    const uint32_t *s = src;
+    for (size_t i = 0; i < FPU_STATE_SIZE / sizeof(uint32_t); i++) {
+        d[i] = s[i];
+    }
+}
+
+// #NM: the running process used the FPU for the first time since it was switched in
+void fpu_nm_handler(void) {
+    set_ts(0);
+    uint8_t pid = current_pid;
+    if (pid == fpu_owner) return;
+
+    // Save the previous owner first, before anything else can touch the registers
+    if (fpu_owner != 255) {
+        __asm__ volatile("fxsave (%0)" : : "r"(proc_table[fpu_owner].fpu_state) : "memory");
+        fpu_owner = 255;
+    }
+
+    struct Procent *cur = &proc_table[pid];
+    if (cur->fpu_state == NULL) {
+        cur->fpu_state = slab_alloc(fpu_cache);
+        if (cur->fpu_state) {
+            fpu_copy(cur->fpu_state, fpu_clean);
+        }
+    }
+    if (cur->fpu_state == NULL) {
+        // No memory: run on clean registers, which are lost at the next switch
+        klog_error("fpu: no memory for FPU state");
+        __asm__ volatile("fxrstor (%0)" : : "r"(fpu_clean) : "memory");
+        return;
+    }
+    __asm__ volatile("fxrstor (%0)" : : "r"(cur->fpu_state) : "memory");
+    fpu_owner = pid;
+}
+
+void fpu_release(uint8_t pid) {
+    struct Procent *p = &proc_table[pid];
+    if (fpu_owner == pid) {
+        fpu_owner = 255; // Its registers are garbage now; nobody needs them saved
+    }
+    if (p->fpu_state) {
+        slab_free(fpu_cache, p->fpu_state);
+        p->fpu_state = NULL;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "types.h"
+
+// Lazy x87/SSE context switching.
+// Each process that uses the FPU gets a 512-byte fxsave area. Registers are swapped only on
+// the first FPU/SSE instruction after a switch: the switch sets CR0.TS, that instruction traps
+// (#NM), and the trap saves the previous owner's state and loads the current process's.
+// Processes that never touch the FPU never trap, and switches between them never write CR0.
+// Interrupt handlers must not use the FPU: they would run on the interrupted process's state.
+// Neither may the rest of the kernel: it is built with -mno-sse, and memcpy and friends use
+// integer moves only. An SSE copy would clobber the XMM state of whichever process owns the FPU.
+
+#define FPU_STATE_SIZE 512
+
+// Enable SSE (CR4.OSFXSR) and install the #NM handler. Needs the slab allocator.
+// Without FXSR/SSE support the FPU is left as the bootloader set it, unmanaged.
+void fpu_init(void);
+
+// Called by switch_process: next runs now, so trap its first FPU use unless it owns the FPU.
+void fpu_switch(uint8_t next_pid);
+
+// Free a reaped process's FPU state.
+void fpu_release(uint8_t pid);
+
+#endif // FPU_H
@@ -1,79 +1,688 @@
 #include "heap.h"
 #include "debug.h"
+#include "pmem.h"
+#include "slab.h"
+#include "string.h"
+#include "serial.h"
+#include "system.h"
 
-#define HEAP_SIZE (64 * 1024) // 64KB Heap
+#define HEAP_SIZE (64 * 1024) // 64KB bootstrap heap, usable before pmem_init()
+#define HEAP_GROW_MIN (256 * 1024) // Kernel arena grows from physical memory in at least 256KB steps
+#define ARENA_GROW_MIN PMEM_CHUNK_SIZE // Process arenas grow one pmem chunk at a time
 #define ALIGNMENT 16
+#define KERNEL_OWNER 255 // Owner tag of blocks allocated outside any process
+#define BLOCK_CLEAN 0x01 // Never used since the memory was zeroed: data is zero past the free-list links
+#define BLOCK_CACHED 0x02 // Parked in its arena's small-block cache (is_free stays 0)
+#define BLOCK_REMOTE 0x04 // Freed by another process, waiting on its arena's remote list
+#define CACHE_MAX 16 // Small blocks an arena keeps per size class before flushing some to the bins
+#define CACHE_BATCH 8 // Blocks moved between a cache and the bins at a time
 
 // Header for each memory block
 // We need to ensure the header itself is aligned or handled such that the data following it is aligned.
-// If ALIGNMENT is 16, and we return (address + sizeof(BlockHeader)), sizeof(BlockHeader) should be a multiple of 16 
+// If ALIGNMENT is 16, and we return (address + sizeof(BlockHeader)), sizeof(BlockHeader) should be a multiple of 16
 // OR we handle the offset calculation carefully.
 // Simplest way: Make struct BlockHeader size a multiple of 16.
 
+// Blocks form a doubly linked list in address order, so both physical neighbours of a
+// block are one pointer away and free() can coalesce in constant time.
+
 struct BlockHeader {
     size_t size;           // Size of the data block (excluding header)
     struct BlockHeader* next; // Next block in the list
+    struct BlockHeader* prev; // Previous block in the list
     uint8_t is_free;       // 1 if free, 0 if used
-    uint8_t padding[7];    // Padding to ensure sizeof(BlockHeader) is 16 bytes (4+4+1+7=16) on 32-bit
+    uint8_t owner;         // PID whose arena holds the block (KERNEL_OWNER for the kernel arena)
+    uint8_t flags;         // BLOCK_CLEAN, BLOCK_CACHED, BLOCK_REMOTE
+    uint8_t padding[1];    // Padding to ensure sizeof(BlockHeader) is 16 bytes (4+4+4+1+1+1+1=16) on 32-bit
+};
+
+_Static_assert(sizeof(struct BlockHeader) % ALIGNMENT == 0, "BlockHeader must keep payloads aligned");
+
+// The heap is a set of regions: the static bootstrap array plus chunks taken from pmem.
+// Each region starts with a HeapRegion header and ends with a zero-size "fence" block that
+// is always in use, so coalescing never runs off the end of a region.
+//
+// [HeapRegion][BlockHeader|data][BlockHeader|data]...[fence BlockHeader]
+struct HeapRegion {
+    struct HeapRegion* next; // Next region (most recently added first)
+    size_t size;             // Total bytes including this header and the fence
+    uint8_t reserved[8];     // Keeps sizeof(HeapRegion) at 16 so blocks stay aligned
 };
 
-// The global heap memory array
+_Static_assert(sizeof(struct HeapRegion) % ALIGNMENT == 0, "HeapRegion must keep blocks aligned");
+
+// Free blocks keep their free-list links in the (otherwise unused) data area.
+// Every block has at least ALIGNMENT bytes of data, which is room for two pointers.
+// Cached and remote-freed blocks reuse next_free for their singly linked lists.
+struct FreeLinks {
+    struct BlockHeader* next_free;
+    struct BlockHeader* prev_free;
+};
+
+// Segregated free lists (size classes)
+// Bins 0..15 hold exact sizes 16, 32, ..., 256 bytes, so a small request is served by
+// popping the head of its bin. Bins 16..31 hold power-of-two ranges (256, 512], (512, 1K], ...
+// and the last bin catches everything bigger.
+// bin_bitmap has bit i set when bins[i] is non-empty, so the next usable bin is one ctz away.
+#define NUM_SMALL_BINS 16
+#define SMALL_BIN_LIMIT (NUM_SMALL_BINS * ALIGNMENT)
+#define NUM_BINS 32
+
+// Arenas
+// Every process allocates from its own arena: private bins and regions taken from pmem.
+// Blocks are tagged with the owner PID, so free() from any process finds the right arena,
+// and a terminated process gives back its whole arena region by region (heap_release),
+// without touching individual blocks. The kernel arena starts on the static bootstrap array and
+// belongs to the boot code and then to the null process.
+//
+// Preemption
+// An arena's bins and block list are only ever touched by its owner, so the owner runs them
+// without disabling interrupts: whoever preempts it works on a different arena. A free() of
+// another arena's block only pushes it onto that arena's remote list, with interrupts off for
+// the push, and the owner drains the list on its next slow-path allocation. Freed small blocks
+// go to a per-arena cache that malloc() pops in a few instructions and that is refilled and
+// flushed in batches of CACHE_BATCH. State shared by every arena (pmem, the arena slab, the
+// heap-wide counters and bounds) is updated in irq_save() sections a few instructions long.
+struct heap_arena {
+    struct BlockHeader* bins[NUM_BINS];
+    uint32_t bin_bitmap;      // Bit i set when bins[i] is non-empty
+    struct HeapRegion* regions;
+    struct HeapRegion* grow_region; // Most recently grown region (extended in place when pmem hands out the chunk right after it)
+    size_t grow_min;
+    uint8_t owner;
+
+    // Recently freed small blocks, one LIFO per exact size class
+    struct BlockHeader* cache[NUM_SMALL_BINS];
+    uint8_t cache_count[NUM_SMALL_BINS];
+
+    // Blocks freed by other processes, pushed with interrupts disabled
+    struct BlockHeader* volatile remote;
+
+    // Non-zero while the owner is changing the block lists: if it is preempted there, the
+    // links are half spliced and heap_stats()/heap_dump() must not walk them
+    volatile uint8_t busy;
+
+    // Accounting
+    size_t bytes_in_use;      // Data bytes of allocated blocks
+    size_t blocks_in_use;
+};
+
+// The bootstrap heap memory array
 static uint8_t heap_memory[HEAP_SIZE] __attribute__((aligned(ALIGNMENT)));
 
-// Head of the linked list
-static struct BlockHeader* heap_head = NULL;
+static struct heap_arena kernel_arena;
+
+// Process arena descriptors come from a slab cache
+static struct slab_cache* arena_cache = NULL;
+
+// Heap-wide counters, reported by heap_stats()
+static uint32_t alloc_count = 0;
+static uint32_t free_count = 0;
+static uint32_t failed_count = 0;
+static size_t total_in_use = 0;
+static size_t peak_in_use = 0;
+
+// Lowest and highest heap addresses, for the free() sanity check
+static uint8_t* heap_lo = NULL;
+static uint8_t* heap_hi = NULL;
+
+static inline struct FreeLinks* free_links(struct BlockHeader* block) {
+    return (struct FreeLinks*)((uint8_t*)block + sizeof(struct BlockHeader));
+}
+
+// Map an aligned block size to its bin index.
+static int size_class(size_t size) {
+    if (size <= SMALL_BIN_LIMIT) {
+        return (int)(size / ALIGNMENT) - 1;
+    }
+    // size is in (256 * 2^k, 256 * 2^(k+1)]  =>  k = floor(log2((size - 1) / 256))
+    int k = 31 - __builtin_clz((size - 1) / SMALL_BIN_LIMIT);
+    int bin = NUM_SMALL_BINS + k;
+    return bin < NUM_BINS ? bin : NUM_BINS - 1;
+}
+
+static void bin_insert(struct heap_arena* arena, struct BlockHeader* block) {
+    int bin = size_class(block->size);
+    struct FreeLinks* links = free_links(block);
+
+    links->prev_free = NULL;
+    links->next_free = arena->bins[bin];
+    if (arena->bins[bin] != NULL) {
+        free_links(arena->bins[bin])->prev_free = block;
+    }
+    arena->bins[bin] = block;
+    arena->bin_bitmap |= (1U << bin);
+}
+
+static void bin_remove(struct heap_arena* arena, struct BlockHeader* block) {
+    int bin = size_class(block->size);
+    struct FreeLinks* links = free_links(block);
+
+    if (links->prev_free != NULL) {
+        free_links(links->prev_free)->next_free = links->next_free;
+    } else {
+        arena->bins[bin] = links->next_free;
+    }
+    if (links->next_free != NULL) {
+        free_links(links->next_free)->prev_free = links->prev_free;
+    }
+    if (arena->bins[bin] == NULL) {
+        arena->bin_bitmap &= ~(1U << bin);
+    }
+}
+
+// Find a free block of at least `size` bytes and unlink it from its bin.
+static struct BlockHeader* bin_take(struct heap_arena* arena, size_t size) {
+    int bin = size_class(size);
+
+    if (bin < NUM_SMALL_BINS) {
+        // Exact-size bin: any block here fits.
+        if (arena->bins[bin] != NULL) {
+            struct BlockHeader* block = arena->bins[bin];
+            bin_remove(arena, block);
+            return block;
+        }
+    } else {
+        // Range bin: blocks may be smaller than the request, first-fit within the bin.
+        for (struct BlockHeader* block = arena->bins[bin]; block != NULL; block = free_links(block)->next_free) {
+            if (block->size >= size) {
+                bin_remove(arena, block);
+                return block;
+            }
+        }
+    }
+
+    // Any block in a higher non-empty bin is large enough.
+    uint32_t higher = arena->bin_bitmap & ~((2U << bin) - 1);
+    if (higher == 0) return NULL;
+
+    struct BlockHeader* block = arena->bins[__builtin_ctz(higher)];
+    bin_remove(arena, block);
+    return block;
+}
+
+static inline struct BlockHeader* region_fence(struct HeapRegion* region) {
+    return (struct BlockHeader*)((uint8_t*)region + region->size - sizeof(struct BlockHeader));
+}
+
+// Mark a block free, merge it with free neighbours and put the result in its bin.
+static void block_release(struct heap_arena* arena, struct BlockHeader* header) {
+    header->is_free = 1;
+    header->flags &= ~BLOCK_CLEAN;
+
+    // Coalesce (Merge) with the next block if it's free
+    struct BlockHeader* next = header->next;
+    if (next != NULL && next->is_free) {
+        bin_remove(arena, next);
+        header->size += sizeof(struct BlockHeader) + next->size;
+        header->next = next->next;
+        if (header->next != NULL) {
+            header->next->prev = header;
+        }
+    }
+
+    // Coalesce with the previous block if it's free
+    struct BlockHeader* prev = header->prev;
+    if (prev != NULL && prev->is_free) {
+        bin_remove(arena, prev);
+        prev->size += sizeof(struct BlockHeader) + header->size;
+        prev->next = header->next;
+        if (prev->next != NULL) {
+            prev->next->prev = prev;
+        }
+        prev->flags &= ~BLOCK_CLEAN;
+        header = prev;
+    }
+
+    bin_insert(arena, header);
+}
+
+// Widen [heap_lo, heap_hi) to cover a region. Shared by every arena.
+static void heap_bounds(uint8_t* lo, uint8_t* hi) {
+    uintptr_t flags = irq_save();
+    if (heap_lo == NULL || lo < heap_lo) heap_lo = lo;
+    if (hi > heap_hi) heap_hi = hi;
+    irq_restore(flags);
+}
+
+// Turn [mem, mem + size) into a heap region holding one free block.
+// `clean` says the memory is known to be zero (BSS), so calloc can skip zeroing it.
+static void region_add(struct heap_arena* arena, void* mem, size_t size, int clean) {
+    struct HeapRegion* region = (struct HeapRegion*)mem;
+    region->size = size;
+    region->next = arena->regions;
+    arena->regions = region;
+    arena->grow_region = region;
+
+    struct BlockHeader* first = (struct BlockHeader*)((uint8_t*)region + sizeof(struct HeapRegion));
+    struct BlockHeader* fence = region_fence(region);
+
+    first->size = size - sizeof(struct HeapRegion) - 2 * sizeof(struct BlockHeader);
+    first->prev = NULL;
+    first->next = fence;
+    first->is_free = 1;
+    first->owner = arena->owner;
+    first->flags = clean ? BLOCK_CLEAN : 0;
+
+    fence->size = 0;
+    fence->prev = first;
+    fence->next = NULL;
+    fence->is_free = 0;
+    fence->owner = arena->owner;
+    fence->flags = 0;
+
+    bin_insert(arena, first);
+    heap_bounds((uint8_t*)region, (uint8_t*)region + size);
+}
+
+// Extend a region by `bytes` that sit directly after it.
+// The old fence becomes a free block covering the new space and a new fence goes at the end.
+static void region_extend(struct heap_arena* arena, struct HeapRegion* region, size_t bytes) {
+    struct BlockHeader* old_fence = region_fence(region);
+    region->size += bytes;
+    struct BlockHeader* fence = region_fence(region);
+
+    fence->size = 0;
+    fence->prev = old_fence;
+    fence->next = NULL;
+    fence->is_free = 0;
+    fence->owner = arena->owner;
+    fence->flags = 0;
+
+    old_fence->size = bytes - sizeof(struct BlockHeader);
+    old_fence->next = fence;
+    block_release(arena, old_fence);
+    heap_bounds((uint8_t*)region, (uint8_t*)region + region->size);
+}
+
+// Get more memory from pmem so that a block of `size` bytes fits.
+// Returns 0 on success, -1 when physical memory is exhausted (or pmem is not set up).
+static int heap_grow(struct heap_arena* arena, size_t size) {
+    size_t needed = size + sizeof(struct HeapRegion) + 2 * sizeof(struct BlockHeader);
+    size_t bytes = needed > arena->grow_min ? needed : arena->grow_min;
+    bytes = (bytes + PMEM_CHUNK_SIZE - 1) & ~(size_t)(PMEM_CHUNK_SIZE - 1);
+
+    uint8_t* mem = (uint8_t*)pmem_alloc(bytes);
+    if (mem == NULL) return -1;
+
+    if (arena->grow_region != NULL && mem == (uint8_t*)arena->grow_region + arena->grow_region->size) {
+        region_extend(arena, arena->grow_region, bytes);
+    } else {
+        region_add(arena, mem, bytes, 0);
+    }
+
+    kdebug_puts("[HEAP] Grew by ");
+    kdebug_puthex(bytes);
+    kdebug_puts(" bytes\n");
+    return 0;
+}
+
+static void arena_init(struct heap_arena* arena, uint8_t owner, size_t grow_min) {
+    for (int i = 0; i < NUM_BINS; i++) {
+        arena->bins[i] = NULL;
+    }
+    arena->bin_bitmap = 0;
+    arena->regions = NULL;
+    arena->grow_region = NULL;
+    arena->grow_min = grow_min;
+    arena->owner = owner;
+    arena->bytes_in_use = 0;
+    arena->blocks_in_use = 0;
+    for (int i = 0; i < NUM_SMALL_BINS; i++) {
+        arena->cache[i] = NULL;
+        arena->cache_count[i] = 0;
+    }
+    arena->remote = NULL;
+    arena->busy = 0;
+}
+
+// Bracket the owner's changes to its arena. The barriers keep the compiler from moving
+// list updates outside the bracket; one CPU needs nothing more.
+static inline void arena_enter(struct heap_arena* arena) {
+    arena->busy++;
+    __asm__ volatile("" : : : "memory");
+}
+
+static inline void arena_exit(struct heap_arena* arena) {
+    __asm__ volatile("" : : : "memory");
+    arena->busy--;
+}
 
 void heap_init(void) {
-    if (heap_head != NULL) return; // Already initialized
-
-    heap_head = (struct BlockHeader*)heap_memory;
-    // The first block covers the whole heap minus the first header
-    heap_head->size = HEAP_SIZE - sizeof(struct BlockHeader);
-    heap_head->next = NULL;
-    heap_head->is_free = 1;
-    
+    if (kernel_arena.regions != NULL) return; // Already initialized
+
+    arena_init(&kernel_arena, KERNEL_OWNER, HEAP_GROW_MIN);
+    region_add(&kernel_arena, heap_memory, HEAP_SIZE, 1);
+
+    // The cache descriptor itself is malloc'd, so this must come after the bootstrap region
+    arena_cache = slab_cache_create("heap_arena", sizeof(struct heap_arena), 0, NULL);
+
     //kdebug_puts("[HEAP] Initialized 64KB heap with 16-byte alignment.\n");
 }
 
-// Malloc: Allocates memory
-void* malloc(size_t size) {
+// --- Heap-wide counters (shared by every arena) ---
+
+static void count_alloc(size_t bytes) {
+    uintptr_t flags = irq_save();
+    alloc_count++;
+    total_in_use += bytes;
+    if (total_in_use > peak_in_use) peak_in_use = total_in_use;
+    irq_restore(flags);
+}
+
+static void count_free(size_t bytes) {
+    uintptr_t flags = irq_save();
+    free_count++;
+    total_in_use -= bytes;
+    irq_restore(flags);
+}
+
+static void count_failed(void) {
+    uintptr_t flags = irq_save();
+    failed_count++;
+    irq_restore(flags);
+}
+
+// Arena of the running context, or NULL if it has none yet.
+// The boot code (no current process) and then the null process (PID 0) own the kernel arena.
+static struct heap_arena* own_arena(void) {
+    if (current_pid == 255 || current_pid == 0) return &kernel_arena;
+    return proc_table[current_pid].heap;
+}
+
+// Arena of the running process, created on its first allocation.
+// Returns NULL if no descriptor can be allocated (pmem exhausted or not set up).
+static struct heap_arena* current_arena(void) {
     // Note: heap_init() must be called once during kernel startup!
-    if (heap_head == NULL) {
+    // It runs here, before the caller marks its arena busy, since heap_init() resets the flag.
+    if (kernel_arena.regions == NULL) {
          // Auto-init fallback
          heap_init();
     }
 
+    struct heap_arena* arena = own_arena();
+    if (arena == NULL && arena_cache != NULL) {
+        uintptr_t flags = irq_save(); // The descriptor slab is shared by every process
+        arena = slab_alloc(arena_cache);
+        irq_restore(flags);
+        if (arena != NULL) {
+            arena_init(arena, current_pid, ARENA_GROW_MIN);
+            proc_table[current_pid].heap = arena;
+        }
+    }
+    if (arena == NULL) {
+        count_failed();
+        klog_error("malloc: no heap arena for this process");
+    }
+    return arena;
+}
+
+// Arena a block belongs to, from its owner tag. NULL if that process is gone.
+static struct heap_arena* block_arena(struct BlockHeader* header) {
+    if (header->owner == KERNEL_OWNER) return &kernel_arena;
+    if (header->owner >= NPROC) return NULL;
+    return proc_table[header->owner].heap;
+}
+
+// Mark a taken block allocated, account for it and return its data area.
+static void* block_claim(struct heap_arena* arena, struct BlockHeader* current) {
+    current->is_free = 0;
+    arena->bytes_in_use += current->size;
+    arena->blocks_in_use++;
+    count_alloc(current->size);
+    // Return pointer to the data area (just after the header)
+    return (void*)((uint8_t*)current + sizeof(struct BlockHeader));
+}
+
+// Undo block_claim's accounting for a block that is being freed.
+static void block_unclaim(struct heap_arena* arena, struct BlockHeader* current) {
+    arena->bytes_in_use -= current->size;
+    arena->blocks_in_use--;
+    count_free(current->size);
+}
+
+// Release the blocks other processes freed into this arena. Owner only.
+static void arena_drain(struct heap_arena* arena) {
+    if (arena->remote == NULL) return;
+
+    uintptr_t flags = irq_save();
+    struct BlockHeader* block = arena->remote;
+    arena->remote = NULL;
+    irq_restore(flags);
+
+    while (block != NULL) {
+        struct BlockHeader* next = free_links(block)->next_free;
+        block->flags &= ~BLOCK_REMOTE;
+        block_unclaim(arena, block);
+        block_release(arena, block);
+        block = next;
+    }
+}
+
+// Take a free block of at least `size` bytes out of the arena's bins, growing the arena if needed.
+static struct BlockHeader* arena_take(struct heap_arena* arena, size_t size) {
+    arena_drain(arena);
+    struct BlockHeader* block = bin_take(arena, size);
+    if (block == NULL && heap_grow(arena, size) == 0) {
+        block = bin_take(arena, size);
+    }
+    if (block == NULL) {
+        count_failed();
+        klog_error("malloc: Out of memory");
+    }
+    return block;
+}
+
+// Cut `current` down to `size` bytes and return the remainder as a new in-use block.
+// The caller makes sure the remainder holds a header and at least ALIGNMENT bytes.
+static struct BlockHeader* block_split(struct heap_arena* arena, struct BlockHeader* current, size_t size) {
+    struct BlockHeader* new_block = (struct BlockHeader*)((uint8_t*)current + sizeof(struct BlockHeader) + size);
+
+    new_block->size = current->size - size - sizeof(struct BlockHeader);
+    new_block->next = current->next;
+    new_block->prev = current;
+    new_block->is_free = 0;
+    new_block->owner = arena->owner;
+    new_block->flags = current->flags; // The tail of a clean block is still clean
+    if (new_block->next != NULL) {
+        new_block->next->prev = new_block;
+    }
+
+    current->size = size;
+    current->next = new_block;
+    return new_block;
+}
+
+// Split whatever a taken block has beyond `size` bytes off as a new free block.
+static void block_trim(struct heap_arena* arena, struct BlockHeader* current, size_t size) {
+    // Can we split it? We need enough space for a new header + at least ALIGNMENT bytes
+    if (current->size >= size + sizeof(struct BlockHeader) + ALIGNMENT) {
+        struct BlockHeader* tail = block_split(arena, current, size);
+        tail->is_free = 1;
+        bin_insert(arena, tail);
+    }
+}
+
+// --- Small-block cache ---
+
+static void cache_push(struct heap_arena* arena, struct BlockHeader* block) {
+    int cls = size_class(block->size);
+    block->flags = (block->flags & ~BLOCK_CLEAN) | BLOCK_CACHED;
+    free_links(block)->next_free = arena->cache[cls];
+    arena->cache[cls] = block;
+    arena->cache_count[cls]++;
+}
+
+static struct BlockHeader* cache_pop(struct heap_arena* arena, int cls) {
+    struct BlockHeader* block = arena->cache[cls];
+    if (block != NULL) {
+        arena->cache[cls] = free_links(block)->next_free;
+        arena->cache_count[cls]--;
+        block->flags &= ~BLOCK_CACHED;
+    }
+    return block;
+}
+
+// Give up to `count` cached blocks of a size class back to the bins.
+static void cache_flush(struct heap_arena* arena, int cls, int count) {
+    struct BlockHeader* block;
+    while (count-- > 0 && (block = cache_pop(arena, cls)) != NULL) {
+        block_release(arena, block);
+    }
+}
+
+// Serve a small block of exactly `size` bytes, refilling its cache in one batch when empty:
+// from blocks of that size already in the bins, or else by carving CACHE_BATCH neighbours
+// out of one larger free block.
+static struct BlockHeader* cache_take(struct heap_arena* arena, size_t size) {
+    int cls = size_class(size);
+    struct BlockHeader* block = cache_pop(arena, cls);
+    if (block != NULL) return block;
+
+    arena_drain(arena);
+    if (arena->bins[cls] != NULL) {
+        block = arena->bins[cls];
+        bin_remove(arena, block);
+        for (int i = 1; i < CACHE_BATCH && arena->bins[cls] != NULL; i++) {
+            struct BlockHeader* extra = arena->bins[cls];
+            bin_remove(arena, extra);
+            extra->is_free = 0;
+            cache_push(arena, extra);
+        }
+        return block;
+    }
+
+    size_t run = CACHE_BATCH * (size + sizeof(struct BlockHeader)) - sizeof(struct BlockHeader);
+    block = bin_take(arena, run);
+    if (block == NULL) {
+        // Too fragmented (or too little memory) for a whole batch: fall back to one block
+        block = arena_take(arena, size);
+        if (block != NULL) block_trim(arena, block, size);
+        return block;
+    }
+
+    block_trim(arena, block, run);
+    struct BlockHeader* piece = block;
+    for (int i = 1; i < CACHE_BATCH; i++) {
+        piece = block_split(arena, piece, size);
+    }
+    // The first piece is handed out, the other CACHE_BATCH - 1 follow it in memory.
+    // The last one also holds any slack block_trim could not split off.
+    piece = block;
+    for (int i = 1; i < CACHE_BATCH; i++) {
+        piece = piece->next;
+        if (piece->size == size) {
+            cache_push(arena, piece);
+        } else {
+            block_release(arena, piece);
+        }
+    }
+    return block;
+}
+
+// Malloc: Allocates memory
+void* malloc(size_t size) {
     if (size == 0) return NULL;
 
     // Align the requested size
     size_t aligned_size = (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
 
-    struct BlockHeader* current = heap_head;
-    while (current != NULL) {
-        if (current->is_free && current->size >= aligned_size) {
-            // Found a suitable block
-            
-            // Can we split it? We need enough space for a new header + at least ALIGNMENT bytes
-            if (current->size >= aligned_size + sizeof(struct BlockHeader) + ALIGNMENT) {
-                struct BlockHeader* new_block = (struct BlockHeader*)((uint8_t*)current + sizeof(struct BlockHeader) + aligned_size);
-                
-                new_block->size = current->size - aligned_size - sizeof(struct BlockHeader);
-                new_block->next = current->next;
-                new_block->is_free = 1;
-
-                current->size = aligned_size;
-                current->next = new_block;
-            }
+    struct heap_arena* arena = current_arena();
+    if (arena == NULL) return NULL;
+
+    struct BlockHeader* current;
+    void* ptr = NULL;
+    arena_enter(arena);
+    if (aligned_size <= SMALL_BIN_LIMIT) {
+        current = cache_take(arena, aligned_size);
+    } else {
+        current = arena_take(arena, aligned_size);
+        if (current != NULL) block_trim(arena, current, aligned_size);
+    }
+    if (current != NULL) ptr = block_claim(arena, current);
+    arena_exit(arena);
+    return ptr;
+}
+
+// Memalign: Allocates memory whose address is a multiple of `alignment` (a power of two)
+void* memalign(size_t alignment, size_t size) {
+    if (alignment <= ALIGNMENT) return malloc(size);
+    if (size == 0 || (alignment & (alignment - 1)) != 0) return NULL;
+
+    size_t aligned_size = (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+
+    // Over-allocate so an aligned data address exists with room for a free block in front of it.
+    // The slack is split off on both sides and goes straight back to the bins.
+    struct heap_arena* arena = current_arena();
+    if (arena == NULL) return NULL;
+    arena_enter(arena);
+    struct BlockHeader* block = arena_take(arena, aligned_size + alignment + sizeof(struct BlockHeader) + ALIGNMENT);
+    if (block == NULL) {
+        arena_exit(arena);
+        return NULL;
+    }
 
-            current->is_free = 0;
-            // Return pointer to the data area (just after the header)
-            return (void*)((uint8_t*)current + sizeof(struct BlockHeader));
+    uintptr_t data = (uintptr_t)block + sizeof(struct BlockHeader);
+    uintptr_t target = (data + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (target != data && target - data < sizeof(struct BlockHeader) + ALIGNMENT) {
+        target += alignment; // Gap too small to hold a free block
+    }
+
+    if (target != data) {
+        // Carve the leading gap off as a free block of its own
+        struct BlockHeader* aligned_block = (struct BlockHeader*)(target - sizeof(struct BlockHeader));
+        size_t lead = target - data;
+
+        aligned_block->size = block->size - lead;
+        aligned_block->next = block->next;
+        aligned_block->prev = block;
+        aligned_block->is_free = 1;
+        aligned_block->owner = arena->owner;
+        aligned_block->flags = block->flags;
+        if (aligned_block->next != NULL) {
+            aligned_block->next->prev = aligned_block;
         }
-        current = current->next;
+
+        block->size = lead - sizeof(struct BlockHeader);
+        block->next = aligned_block;
+        bin_insert(arena, block);
+        block = aligned_block;
+    }
+
+    block_trim(arena, block, aligned_size);
+    void* ptr = block_claim(arena, block);
+    arena_exit(arena);
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+// Calloc: Allocates zeroed memory for an array
+void* calloc(size_t nmemb, size_t size) {
+    if (nmemb != 0 && size > (size_t)-1 / nmemb) return NULL; // Overflow
+
+    size_t total = nmemb * size;
+    if (total == 0) return NULL;
+    size_t aligned_size = (total + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+
+    struct heap_arena* arena = current_arena();
+    if (arena == NULL) return NULL;
+    arena_enter(arena);
+    struct BlockHeader* current = arena_take(arena, aligned_size);
+    if (current == NULL) {
+        arena_exit(arena);
+        return NULL;
     }
+    block_trim(arena, current, aligned_size);
 
-    //klog_error("malloc: Out of memory");
-    return NULL;
+    // Never-used memory is already zero except for the free-list links at its start
+    size_t dirty = (current->flags & BLOCK_CLEAN) ? sizeof(struct FreeLinks) : total;
+    void* ptr = block_claim(arena, current);
+    arena_exit(arena);
+    memset(ptr, 0, dirty < total ? dirty : total);
+    return ptr;
 }
 
 // Free: Frees memory
@@ -82,31 +691,47 @@ void free(void* ptr) {
 
     // Get the header (it sits immediately before the pointer)
     struct BlockHeader* header = (struct BlockHeader*)((uint8_t*)ptr - sizeof(struct BlockHeader));
-    
+
     // Sanity check: ensure this pointer is actually within our heap range
-    if ((uint8_t*)header < heap_memory || (uint8_t*)header >= heap_memory + HEAP_SIZE) {
+    if ((uint8_t*)header < heap_lo || (uint8_t*)header >= heap_hi) {
         //klog_error("free: Invalid pointer (outside heap range)");
         return;
     }
 
-    header->is_free = 1;
-
-    // Coalesce (Merge) with the next block if it's free
-    if (header->next != NULL && header->next->is_free) {
-        header->size += sizeof(struct BlockHeader) + header->next->size;
-        header->next = header->next->next;
+    struct heap_arena* arena = block_arena(header);
+    if (arena != NULL && arena == own_arena()) {
+        if (header->is_free || (header->flags & (BLOCK_CACHED | BLOCK_REMOTE))) {
+            klog_error("free: block already free");
+            return;
+        }
+        arena_enter(arena);
+        block_unclaim(arena, header);
+        if (header->size > SMALL_BIN_LIMIT) {
+            block_release(arena, header);
+        } else {
+            int cls = size_class(header->size);
+            if (arena->cache_count[cls] >= CACHE_MAX) {
+                cache_flush(arena, cls, CACHE_BATCH);
+            }
+            cache_push(arena, header);
+        }
+        arena_exit(arena);
+        return;
     }
 
-    // Forward Coalescing (Full Sweep)
-    struct BlockHeader* current = heap_head;
-    while (current != NULL) {
-         if (current->is_free && current->next != NULL && current->next->is_free) {
-             current->size += sizeof(struct BlockHeader) + current->next->size;
-             current->next = current->next->next;
-         } else {
-             current = current->next;
-         }
+    // Another arena's block: its owner may be preempted halfway through a list splice,
+    // so only push the block onto the remote list and let the owner release it.
+    uintptr_t flags = irq_save();
+    arena = block_arena(header); // Re-read: the owner may have been reaped meanwhile
+    if (arena == NULL || header->is_free || (header->flags & (BLOCK_CACHED | BLOCK_REMOTE))) {
+        irq_restore(flags);
+        klog_error("free: block owner is gone or block already free");
+        return;
     }
+    header->flags |= BLOCK_REMOTE;
+    free_links(header)->next_free = arena->remote;
+    arena->remote = header;
+    irq_restore(flags);
 }
 
 // Realloc: Resizes memory
@@ -119,7 +744,7 @@ void* realloc(void* ptr, size_t size) {
 
     // Get the header
     struct BlockHeader* header = (struct BlockHeader*)((uint8_t*)ptr - sizeof(struct BlockHeader));
-    
+
     // Align the requested size
     size_t aligned_size = (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
 
@@ -128,13 +753,30 @@ void* realloc(void* ptr, size_t size) {
         return ptr;
     }
 
-    // Optimization 2: Check if next block is free and if merging would provide enough space
-    if (header->next != NULL && header->next->is_free) {
+    // Optimization 2: Check if next block is free and if merging would provide enough space.
+    // Only the owner may touch its arena's bins, so blocks from other arenas always move.
+    struct heap_arena* arena = block_arena(header);
+    if (arena != NULL && arena == own_arena() && header->next != NULL && header->next->is_free) {
         size_t total_space = header->size + sizeof(struct BlockHeader) + header->next->size;
         if (total_space >= aligned_size) {
-            // Absorb the next block
+            // Absorb the next block, then give back what we do not need: the next block
+            // is often the rest of a 64KB region
+            arena_enter(arena);
+            size_t old_size = header->size;
+            bin_remove(arena, header->next);
             header->size = total_space;
             header->next = header->next->next;
+            if (header->next != NULL) {
+                header->next->prev = header;
+            }
+            block_trim(arena, header, aligned_size);
+            size_t grown = header->size - old_size;
+            arena->bytes_in_use += grown;
+            arena_exit(arena);
+            uintptr_t flags = irq_save();
+            total_in_use += grown;
+            if (total_in_use > peak_in_use) peak_in_use = total_in_use;
+            irq_restore(flags);
             // Now we fit!
             return ptr;
         }
@@ -143,13 +785,261 @@ void* realloc(void* ptr, size_t size) {
     // Fallback: Allocate new block, copy data, free old block
     void* new_ptr = malloc(size);
     if (new_ptr) {
-        uint8_t* src = (uint8_t*)ptr;
-        uint8_t* dst = (uint8_t*)new_ptr;
-        size_t copy_size = header->size; 
-        for (size_t i = 0; i < copy_size; i++) {
-            dst[i] = src[i];
-        }
+        memcpy(new_ptr, ptr, header->size);
         free(ptr);
     }
     return new_ptr;
 }
+
+// Give a terminated process's arena back to pmem in one pass over its regions.
+// Cached blocks and pending remote frees go with it.
+int heap_release(pidtype pid) {
+    if (pid >= NPROC) return -1;
+
+    // Unpublish first so no free() from another process can push onto the arena
+    uintptr_t flags = irq_save();
+    struct heap_arena* arena = proc_table[pid].heap;
+    proc_table[pid].heap = NULL;
+    if (arena != NULL) total_in_use -= arena->bytes_in_use;
+    irq_restore(flags);
+    if (arena == NULL) return 0;
+
+    if (arena->blocks_in_use != 0) {
+        kdebug_puts("[HEAP] Reclaiming ");
+        kdebug_puthex(arena->bytes_in_use);
+        kdebug_puts(" leaked bytes\n");
+    }
+
+    struct HeapRegion* region = arena->regions;
+    while (region != NULL) {
+        struct HeapRegion* next = region->next;
+        pmem_free(region, region->size);
+        region = next;
+    }
+    flags = irq_save();
+    slab_free(arena_cache, arena);
+    irq_restore(flags);
+    return 0;
+}
+
+void heap_reclaim(void) {
+    struct heap_arena* arena = own_arena();
+    if (arena == NULL || arena->regions == NULL) return;
+
+    arena_enter(arena);
+    arena_drain(arena);
+    for (int cls = 0; cls < NUM_SMALL_BINS; cls++) {
+        cache_flush(arena, cls, CACHE_MAX);
+    }
+    arena_exit(arena);
+}
+
+int heap_usage(pidtype pid, size_t* bytes, size_t* blocks) {
+    struct heap_arena* arena;
+    if (pid == KERNEL_OWNER) {
+        arena = &kernel_arena;
+    } else if (pid < NPROC) {
+        arena = proc_table[pid].heap;
+    } else {
+        return -1;
+    }
+
+    *bytes = arena != NULL ? arena->bytes_in_use : 0;
+    *blocks = arena != NULL ? arena->blocks_in_use : 0;
+    return 0;
+}
+
+// --- Introspection ---
+
+// Walk every block of an arena and add it to the totals.
+// Cached and remote-freed blocks count as free: they are available, just not coalesced yet.
+static void arena_collect(struct heap_arena* arena, struct heap_stats* stats) {
+    stats->arenas++;
+    for (struct HeapRegion* region = arena->regions; region != NULL; region = region->next) {
+        stats->regions++;
+        stats->total_bytes += region->size;
+
+        struct BlockHeader* fence = region_fence(region);
+        struct BlockHeader* block = (struct BlockHeader*)((uint8_t*)region + sizeof(struct HeapRegion));
+        for (; block != fence; block = block->next) {
+            if (block->is_free || (block->flags & (BLOCK_CACHED | BLOCK_REMOTE))) {
+                stats->free_blocks++;
+                stats->free_bytes += block->size;
+                if (block->size > stats->largest_free) stats->largest_free = block->size;
+            } else {
+                stats->used_blocks++;
+                stats->used_bytes += block->size;
+            }
+        }
+    }
+}
+
+void heap_stats(struct heap_stats* stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    // Read-only. Each arena is walked with interrupts off so its owner cannot change it
+    // meanwhile, and skipped if the owner was preempted in the middle of a change.
+    for (int pid = -1; pid < NPROC; pid++) {
+        uintptr_t flags = irq_save();
+        struct heap_arena* arena = pid < 0 ? &kernel_arena : proc_table[pid].heap;
+        if (arena != NULL && arena->regions != NULL) {
+            if (arena->busy) {
+                stats->busy_arenas++;
+            } else {
+                arena_collect(arena, stats);
+            }
+        }
+        irq_restore(flags);
+    }
+
+    uintptr_t flags = irq_save();
+    stats->peak_used_bytes = peak_in_use;
+    stats->alloc_count = alloc_count;
+    stats->free_count = free_count;
+    stats->failed_count = failed_count;
+    irq_restore(flags);
+
+    // Share of free memory outside the largest free block, in percent.
+    // Divide free_bytes first so the product cannot overflow 32 bits.
+    if (stats->free_bytes > 0) {
+        uint32_t largest_pct = stats->largest_free / ((stats->free_bytes + 99) / 100);
+        stats->fragmentation = largest_pct >= 100 ? 0 : 100 - largest_pct;
+    }
+}
+
+static void dump_field(const char* label, uint32_t value) {
+    serial_puts(label);
+    serial_print_hex(value);
+}
+
+// heap_dump() copies an arena a batch of lines at a time with interrupts off, then prints the
+// batch with them on: the polled serial port takes milliseconds per line.
+#define DUMP_BATCH 16
+
+struct dump_line {
+    uintptr_t addr;   // Region, or data area of a block
+    size_t size;
+    char kind;        // G(region), U(sed), F(ree), C(ached) or R(emote free)
+};
+
+// Where the previous batch stopped: the region being walked and the last block copied from it
+struct dump_cursor {
+    struct HeapRegion* region;
+    uintptr_t after;
+};
+
+// Copy the next lines of `pid`'s arena (-1: kernel arena) after `cursor`.
+// Returns how many, or -1 if the arena went away or its owner is in the middle of changing it.
+static int arena_snapshot(int pid, struct heap_arena* arena, struct dump_cursor* cursor,
+                          struct dump_line* out) {
+    int n = 0;
+    uintptr_t flags = irq_save();
+    struct heap_arena* now = pid < 0 ? &kernel_arena : proc_table[pid].heap;
+    if (now != arena || arena->busy) {
+        irq_restore(flags);
+        return -1;
+    }
+
+    // Regions are never moved, only added or released: find the one we stopped in
+    struct HeapRegion* region = arena->regions;
+    if (cursor->region != NULL) {
+        while (region != NULL && region != cursor->region) region = region->next;
+        if (region == NULL) {
+            irq_restore(flags);
+            return -1;
+        }
+    }
+
+    while (region != NULL && n < DUMP_BATCH) {
+        if (region != cursor->region) {
+            out[n].addr = (uintptr_t)region;
+            out[n].size = region->size;
+            out[n++].kind = 'G';
+            cursor->region = region;
+            cursor->after = 0;
+            continue;
+        }
+        // Blocks are in address order, so skipping up to the cursor survives merges and splits
+        struct BlockHeader* fence = region_fence(region);
+        struct BlockHeader* block = (struct BlockHeader*)((uint8_t*)region + sizeof(struct HeapRegion));
+        for (; block != fence && n < DUMP_BATCH; block = block->next) {
+            if ((uintptr_t)block <= cursor->after) continue;
+            out[n].addr = (uintptr_t)block + sizeof(struct BlockHeader);
+            out[n].size = block->size;
+            if (block->is_free) {
+                out[n].kind = 'F';
+            } else if (block->flags & BLOCK_CACHED) {
+                out[n].kind = 'C';
+            } else if (block->flags & BLOCK_REMOTE) {
+                out[n].kind = 'R';
+            } else {
+                out[n].kind = 'U';
+            }
+            n++;
+            cursor->after = (uintptr_t)block;
+        }
+        if (block == fence) region = region->next;
+    }
+    irq_restore(flags);
+    return n;
+}
+
+// One line per region and per block: address, size and kind
+static void arena_dump(int pid, struct heap_arena* arena) {
+    struct dump_line lines[DUMP_BATCH];
+    struct dump_cursor cursor = {NULL, 0};
+    int n;
+    while ((n = arena_snapshot(pid, arena, &cursor, lines)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (lines[i].kind == 'G') {
+                dump_field("  region ", lines[i].addr);
+                dump_field(" size=", lines[i].size);
+                serial_puts("\n");
+                continue;
+            }
+            char tail[4] = {' ', lines[i].kind, '\n', '\0'};
+            dump_field("    ", lines[i].addr);
+            dump_field(" ", lines[i].size);
+            serial_puts(tail);
+        }
+    }
+    if (n < 0) {
+        serial_puts("  (owner mid-update, rest skipped)\n");
+    }
+}
+
+void heap_dump(void) {
+    struct heap_stats stats;
+    heap_stats(&stats);
+
+    serial_puts("[HEAP] ---- heap dump ----\n");
+    dump_field("[HEAP] total=", stats.total_bytes);
+    dump_field(" used=", stats.used_bytes);
+    dump_field(" free=", stats.free_bytes);
+    dump_field(" largest_free=", stats.largest_free);
+    dump_field(" peak=", stats.peak_used_bytes);
+    serial_puts("\n");
+    dump_field("[HEAP] used_blocks=", stats.used_blocks);
+    dump_field(" free_blocks=", stats.free_blocks);
+    dump_field(" allocs=", stats.alloc_count);
+    dump_field(" frees=", stats.free_count);
+    dump_field(" failed=", stats.failed_count);
+    dump_field(" frag%=", stats.fragmentation);
+    dump_field(" busy_arenas=", stats.busy_arenas);
+    serial_puts("\n");
+
+    for (int pid = -1; pid < NPROC; pid++) {
+        uintptr_t flags = irq_save();
+        struct heap_arena* arena = pid < 0 ? &kernel_arena : proc_table[pid].heap;
+        int present = arena != NULL && arena->regions != NULL;
+        uint8_t owner = present ? arena->owner : 0;
+        size_t in_use = present ? arena->bytes_in_use : 0;
+        irq_restore(flags);
+        if (!present) continue;
+
+        dump_field("[HEAP] arena owner=", owner);
+        dump_field(" in_use=", in_use);
+        serial_puts("\n");
+        arena_dump(pid, arena);
+    }
+}
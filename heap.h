@@ -2,6 +2,7 @@
 #define MEMORY_HEAP_H
 
 #include "types.h"
+#include "process.h"
 
 void heap_init(void);
 
@@ -9,8 +10,53 @@ void heap_init(void);
 void* malloc(size_t size);
 void free(void* ptr);
 void* realloc(void* ptr, size_t size);
+// Zeroed array allocation. Skips zeroing memory that was never used since boot.
+void* calloc(size_t nmemb, size_t size);
+// Allocation aligned to `alignment` bytes (power of two), e.g. 64 for a cache line or 4096 for a page.
+// The block is released with free(). realloc() does not preserve the alignment.
+void* memalign(size_t alignment, size_t size);
+void* aligned_alloc(size_t alignment, size_t size);
 
 // Returns the base pointer of the heap.
 void* heap_base(void);
 
+// Per-process accounting
+// Bytes and blocks currently allocated by a process (255 = kernel arena).
+// Returns 0 on success, -1 for an invalid PID.
+int heap_usage(pidtype pid, size_t* bytes, size_t* blocks);
+
+// Release a terminated process's whole arena. Every block it still owns becomes invalid.
+int heap_release(pidtype pid);
+
+// Return the running process's cached small blocks and the blocks other processes freed into
+// its arena to the free lists, so they can coalesce. Called by the null process while idle.
+void heap_reclaim(void);
+
+// Introspection
+struct heap_stats {
+    size_t total_bytes;      // Bytes in all heap regions, headers included
+    size_t used_bytes;       // Data bytes in allocated blocks
+    size_t free_bytes;       // Data bytes in free blocks
+    size_t largest_free;     // Largest single free block
+    size_t peak_used_bytes;  // High-water mark of used_bytes since boot
+    uint32_t used_blocks;
+    uint32_t free_blocks;
+    uint32_t regions;
+    uint32_t arenas;
+    uint32_t busy_arenas;    // Arenas left out: their owner was preempted mid-update
+    uint32_t alloc_count;    // Successful mallocs since boot
+    uint32_t free_count;
+    uint32_t failed_count;   // mallocs that returned NULL
+    uint32_t fragmentation;  // 0 = all free memory in one block .. 100 = fully scattered
+};
+
+// Fill stats by walking every arena, without changing anything. Cost is linear in the number
+// of blocks, and each arena is walked with interrupts disabled: meant for diagnostics, not hot
+// paths. Cached small blocks count as free but are not merged, so call heap_reclaim() first
+// for an exact fragmentation figure of your own arena.
+void heap_stats(struct heap_stats* stats);
+
+// Print the stats and a block-by-block map of every arena on the serial port.
+void heap_dump(void);
+
 #endif // MEMORY_HEAP_H
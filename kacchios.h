@@ -2,6 +2,7 @@
 #define KACCHIOS_H
 
 #include "types.h"
+#include "proc_stats.h"
 
 // Define pidtype (matches process.h)
 typedef uint8_t pidtype;
@@ -13,12 +14,56 @@ typedef void (*proc_entry_t)(void *);
 // Returns: PID of created process, or 255 on failure
 pidtype create_process(proc_entry_t entry, const void *arg, const char *name);
 
+// Create a process with its own stack size (1KB .. 16KB, rounded up to a power of two).
+// create_process() uses 4KB.
+pidtype create_process_stack(proc_entry_t entry, const void *arg, const char *name, unsigned int stack_size);
+
 // Get current Process ID
 pidtype getpid(void);
 
+// --- Priorities ---
+// A ready process always runs before every process with a lower priority; equal priorities
+// share the CPU round-robin. New processes start at PRIO_DEFAULT; 0 is the idle level.
+#define PRIO_DEFAULT 16
+#define PRIO_MAX 31
+
+// Change a process's priority. Returns the old priority, or -1 on error.
+int chprio(pidtype pid, uint8_t prio);
+
+// Returns a process's priority, or -1 if pid is invalid.
+int getprio(pidtype pid);
+
+// Nice value (-20 .. 19, default 0) of a process under the fair-share scheduler (sched=fair):
+// CPU is shared in proportion to weights that change by about 10% per step, so a process at
+// nice 0 gets about 3x the CPU of one at nice 5. Returns the old value, or -128 on error.
+int setnice(pidtype pid, int nice);
+
+// Returns a process's nice value, or -128 if pid is invalid.
+int getnice(pidtype pid);
+
 // Terminate a process (or self)
 int kill(pidtype pid);
 
+// Deepest stack use of a process in bytes since it was created, or 0 if pid is invalid.
+// Use it to size create_process_stack() requests.
+size_t proc_stack_high_water(pidtype pid);
+
+// Print the stack high-water mark of every live process on the serial port.
+void proc_stack_report(void);
+
+// CPU accounting of a process (TSC cycles running, ready and blocked, plus voluntary and
+// involuntary switch counts), the current interval included. Returns 0, or -1 if pid is invalid.
+int proc_get_stats(pidtype pid, struct proc_stats *out);
+
+// Print a ps-style table of every live process on the serial port: CPU share, time per
+// state and switch counts. Useful to see who eats the CPU and to tune quanta.
+void proc_ps(void);
+
+// Sleep for at least `ms` milliseconds (10ms resolution) or `ticks` timer ticks. The process
+// uses no CPU until then. 0 just yields. Returns 0, or -1 outside a process.
+int sleep_ms(uint32_t ms);
+int sleep_ticks(uint32_t ticks);
+
 // --- IPC: Message Passing ---
 
 // Send a 32-bit message to a process.
@@ -28,6 +73,29 @@ int send(pidtype pid, uint32_t msg);
 // Receive a 32-bit message. Blocks if no message is available.
 uint32_t receive(void);
 
+// Like send(), but if the receiver is blocked in receive() it runs at once in our place
+// for the rest of our quantum (unless we or a ready process outrank it). Use it to hand work to a
+// server without waiting for its turn.
+int send_yield(pidtype pid, uint32_t msg);
+
+// Synchronous request/reply: send `msg` to pid and block until pid replies, storing the reply
+// in *reply. A receiver already waiting runs immediately in our place, and messages from other
+// processes are refused (send() returns -2) until the reply arrives.
+// Returns: 0 on success, -1 (invalid pid or self), -2 (buffer full) without blocking, or
+// -3 if a message is already waiting for us (receive() it first).
+int call(pidtype pid, uint32_t msg, uint32_t *reply);
+
+// Server side of call(): reply to pid, then wait for the next request from anyone, stored in
+// *next. The caller runs at once, so a round trip costs two context switches:
+//     uint32_t req = receive();
+//     while (1) reply_recv(msg_sender(), handle(req), &req);
+// It always waits for the next request, even when the reply cannot be delivered (the caller
+// died), so the loop above never spins. Returns: 0, or -1/-2 if the reply was not delivered.
+int reply_recv(pidtype pid, uint32_t reply, uint32_t *next);
+
+// Sender of the last message received by the calling process.
+pidtype msg_sender(void);
+
 // --- IPC: Semaphores ---
 
 // Create a semaphore with initial count
@@ -48,6 +116,10 @@ int sem_delete(int sem_id);
 void *malloc(unsigned int size);
 void free(void *ptr);
 void *realloc(void *ptr, unsigned int size);
+void *calloc(unsigned int nmemb, unsigned int size);
+// Aligned allocation (alignment is a power of two, e.g. 64 or 4096); release with free()
+void *memalign(unsigned int alignment, unsigned int size);
+void *aligned_alloc(unsigned int alignment, unsigned int size);
 
 // --- I/O & Utils ---
 #include "serial.h"
@@ -56,5 +128,9 @@ void *realloc(void *ptr, unsigned int size);
 size_t strlen(const char *str);
 char *strcpy(char *dest, const char *src);
 int strcmp(const char *s1, const char *s2);
+void *memcpy(void *dest, const void *src, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
+void *memset(void *dest, int c, size_t n);
+int memcmp(const void *s1, const void *s2, size_t n);
 
 #endif // KACCHIOS_H
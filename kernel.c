@@ -5,17 +5,69 @@
 #include "timer.h"
 #include "heap.h"
 #include "sem.h"
+#include "pmem.h"
+#include "multiboot.h"
+#include "fpu.h"
+#include "stack.h"
 
 // Shared mutex for synchronization
 extern void main(void* arg);
 
-void kmain(void) {
+// End of the kernel image (link.ld); free physical memory starts here
+extern uint8_t __kernel_end[];
+
+// Hand everything between the kernel image and the top of RAM to pmem.
+static void memory_init(uint32_t magic, const struct multiboot_info* mbi) {
+    uintptr_t mem_end = 0;
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && (mbi->flags & MULTIBOOT_INFO_MEMORY)) {
+        mem_end = 0x100000 + mbi->mem_upper * 1024;
+    } else {
+        serial_puts("[Kernel] No Multiboot memory info, heap limited to bootstrap region\n");
+    }
+    pmem_init((uintptr_t)__kernel_end, mem_end);
+}
+
+// True if the space-separated command line contains `word` as a whole token.
+static int cmdline_has(const char* cmdline, const char* word) {
+    while (*cmdline) {
+        const char* w = word;
+        while (*cmdline == ' ') cmdline++;
+        while (*w && *cmdline == *w) { cmdline++; w++; }
+        if (*w == '\0' && (*cmdline == ' ' || *cmdline == '\0')) return 1;
+        while (*cmdline && *cmdline != ' ') cmdline++;
+    }
+    return 0;
+}
+
+// Pick the scheduling policy: sched=mlfq or sched=fair on the command line, round-robin otherwise.
+static void sched_init(uint32_t magic, const struct multiboot_info* mbi) {
+    const char* cmdline = "";
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && (mbi->flags & MULTIBOOT_INFO_CMDLINE)) {
+        cmdline = (const char*)(uintptr_t)mbi->cmdline;
+    }
+    if (cmdline_has(cmdline, "sched=mlfq")) {
+        sched_set_policy(SCHED_MLFQ);
+        serial_puts("[Kernel] Scheduler: MLFQ with aging\n");
+    } else if (cmdline_has(cmdline, "sched=fair")) {
+        sched_set_policy(SCHED_FAIR);
+        serial_puts("[Kernel] Scheduler: fair share (vruntime)\n");
+    } else {
+        sched_set_policy(SCHED_RR);
+        serial_puts("[Kernel] Scheduler: priority round-robin\n");
+    }
+}
+
+void kmain(uint32_t magic, const struct multiboot_info* mbi) {
     serial_init();
     serial_puts("\n--- kacchiOS Booting ---\n");
     
     idt_install();
     timer_init(); 
+    sched_init(magic, mbi); // Before pmem reuses the memory the command line sits in
+    memory_init(magic, mbi);
     heap_init();
+    stack_init(); // Stack caches belong to the kernel, not to the first process that needs one
+    fpu_init(); // Needs the slab allocator for per-process state
     init_proc(); 
     sem_init();
 
@@ -60,10 +60,9 @@ void producer(void *arg) {
 
     const int total_msgs = 5;
     for (int i = 0; i < total_msgs; i++) {
-        // Simple delay loop so output interleaves and
-        // you can see the scheduler at work.
-        for (volatile int j = 0; j < 5000000; j++) {
-        }
+        // Pause so output interleaves and you can see the
+        // scheduler at work; the CPU is free meanwhile.
+        sleep_ms(50);
 
         serial_puts("[producer] sending msg=");
         serial_print_hex(i);
@@ -117,6 +116,25 @@ void heap_worker(void *arg) {
     }
 }
 
+// FPU worker: accumulates a double while other processes run. Two of them share the FPU,
+// and the lazy FPU switch keeps each one's registers intact across preemption and sleeps.
+void fpu_worker(void *arg) {
+    uint32_t step = (uint32_t)(uintptr_t)arg;
+    double sum = 0.0;
+    double inc = 1.0 / step; // Exact for powers of two
+
+    for (uint32_t i = 1; i <= 2000; i++) {
+        sum += inc;
+        if (i % 500 == 0) {
+            sleep_ms(10); // Let the other worker load its own state
+        }
+    }
+
+    serial_puts("[fpu_worker] 1/");
+    serial_print_hex(step);
+    serial_puts(sum == 2000.0 / step ? " sum correct\n" : " sum CORRUPTED\n");
+}
+
 // User-level entry created by kmain() as a process.
 // It orchestrates the demo by creating additional processes
 // and using semaphores to wait for completion.
@@ -130,6 +148,7 @@ void main(void *arg) {
     serial_puts("  - Message Passing (send/receive)\n");
     serial_puts("  - Semaphores (P/V)\n");
     serial_puts("  - Heap (malloc/free)\n");
+    serial_puts("  - Lazy FPU/SSE switching\n");
     serial_puts("===========================================\n\n");
 
     serial_puts("[main] PID=");
@@ -159,6 +178,10 @@ void main(void *arg) {
     create_process(heap_worker, NULL, "heap_worker");
     serial_puts("[main] created heap_worker.\n");
 
+    // Two processes doing floating point at the same time
+    create_process(fpu_worker, (void *)2, "fpu_half");
+    create_process(fpu_worker, (void *)4, "fpu_quarter");
+
     serial_puts("[main] waiting on semaphore from consumer...\n");
     sem_wait(done_sem);
 
@@ -177,6 +200,12 @@ void main(void *arg) {
         serial_puts("[main] malloc(256) FAILED\n");
     }
 
+    // How deep each process's stack has gone so far
+    proc_stack_report();
+
+    // Who used the CPU, and how often each process was switched out
+    proc_ps();
+
     serial_puts("[main] demo complete. main process will now idle.\n");
 
     // Keep main alive so you can continue to see scheduling effects.
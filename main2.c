@@ -7,8 +7,7 @@ void process_a(void* arg) {
         serial_puts("Process A: ");
         serial_print_hex(index++);
         serial_puts("\n");
-        // Busy wait
-        for(volatile int i=0; i<10000000; i++);
+        sleep_ms(100);
     }
 }
 
@@ -19,8 +18,7 @@ void process_b(void* arg) {
         serial_puts("Process B: ");
         serial_print_hex(index++);
         serial_puts("\n");
-        // Busy wait
-        for(volatile int i=0; i<10000000; i++);
+        sleep_ms(100);
     }
 }
 
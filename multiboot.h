@@ -0,0 +1,24 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include "types.h"
+
+// Value left in EAX by a Multiboot-compliant loader (GRUB, QEMU -kernel)
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+// flags bit 0: mem_lower/mem_upper are valid
+#define MULTIBOOT_INFO_MEMORY 0x00000001
+// flags bit 2: cmdline is valid
+#define MULTIBOOT_INFO_CMDLINE 0x00000004
+
+// Leading part of the Multiboot information structure (pointer left in EBX).
+// Only the fields we use are declared.
+struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower; // KB of memory below 1MB
+    uint32_t mem_upper; // KB of memory above 1MB
+    uint32_t boot_device;
+    uint32_t cmdline;   // Physical address of the kernel command line (C string)
+};
+
+#endif // MULTIBOOT_H
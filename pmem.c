@@ -0,0 +1,37 @@
+#include "pmem.h"
+#include "buddy.h"
+#include "debug.h"
+
+#define PAGES_PER_CHUNK (PMEM_CHUNK_SIZE / PAGE_SIZE)
+
+void pmem_init(uintptr_t start, uintptr_t end) {
+    buddy_init(start, end);
+}
+
+static inline size_t chunk_pages(size_t size) {
+    return ((size + PMEM_CHUNK_SIZE - 1) / PMEM_CHUNK_SIZE) * PAGES_PER_CHUNK;
+}
+
+void* pmem_alloc(size_t size) {
+    size_t pages = chunk_pages(size);
+    if (pages == 0) {
+        return NULL;
+    }
+    void* mem = buddy_alloc_pages(pages);
+    if (mem == NULL) {
+        klog_error("pmem_alloc: no contiguous run available");
+    }
+    return mem;
+}
+
+int pmem_free(void* ptr, size_t size) {
+    if (((uintptr_t)ptr & (PMEM_CHUNK_SIZE - 1)) != 0) {
+        klog_error("pmem_free: pointer not chunk aligned");
+        return -1;
+    }
+    return buddy_free_pages(ptr, chunk_pages(size));
+}
+
+size_t pmem_free_bytes(void) {
+    return buddy_free_bytes();
+}
@@ -0,0 +1,25 @@
+#ifndef MEMORY_PMEM_H
+#define MEMORY_PMEM_H
+
+#include "types.h"
+
+// Physical memory region provider.
+// Hands out memory above the kernel image in PMEM_CHUNK_SIZE units. Large consumers
+// (the heap, slabs) grow from here instead of from fixed arrays in BSS.
+// Backed by the page-frame buddy allocator; page-granular users can call buddy.h directly.
+#define PMEM_CHUNK_SIZE (64 * 1024)
+
+// Manage the physical range [start, end). Called once at boot.
+void pmem_init(uintptr_t start, uintptr_t end);
+
+// Allocate at least size bytes (rounded up to whole chunks), chunk aligned.
+// Returns NULL if no contiguous run is available (runs are limited to a max-order buddy block).
+void* pmem_alloc(size_t size);
+
+// Return a region obtained from pmem_alloc. Returns 0 on success, negative on error.
+int pmem_free(void* ptr, size_t size);
+
+// Bytes currently available for pmem_alloc.
+size_t pmem_free_bytes(void);
+
+#endif // MEMORY_PMEM_H
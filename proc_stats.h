@@ -0,0 +1,21 @@
+#ifndef PROC_STATS_H
+#define PROC_STATS_H
+
+#include "types.h"
+
+// Where a process's time is charged, in TSC cycles
+enum {
+    ACCT_RUN = 0, // Running on the CPU
+    ACCT_READY,   // Runnable, waiting in a ready queue
+    ACCT_BLOCKED, // In RECV, WAITING or SLEEPING
+    ACCT_STATES
+};
+
+// CPU accounting of one process since it was created (see proc_get_stats)
+struct proc_stats {
+    uint64_t cycles[ACCT_STATES]; // Indexed by ACCT_RUN, ACCT_READY, ACCT_BLOCKED
+    uint32_t nvcsw;               // Voluntary switches: blocked, slept, yielded or exited
+    uint32_t nivcsw;              // Involuntary switches: preempted while runnable
+};
+
+#endif // PROC_STATS_H
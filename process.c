@@ -1,18 +1,83 @@
 #include "process.h"
+#include "bitmap.h"
 #include "serial.h"
 #include "stack.h"
 #include "string.h"
 #include "system.h"
 #include "debug.h"
+#include "heap.h"
+#include "sem.h"
+#include "timer.h"
+#include "fpu.h"
 
 void switch_process(pidtype next_pid);
 
 struct Procent proc_table[NPROC];
 struct ProcessNode proc_nodes[NPROC];
 
-// Ready list head PID (255 means empty)
-pidtype ready_list = 255;
-static pidtype proc_create(proc_entry_t entry, const void *arg, const char *name);
+// One circular ready queue per priority level, threaded through proc_nodes (255 = empty),
+// and a bitmap of the non-empty levels. The running process is never queued: it goes back
+// to the tail of its level when it is switched out while still runnable.
+pidtype ready_queues[NPRIO];
+uint32_t ready_bitmap = 0;
+static uint32_t sched_ticks = 0; // Ticks seen by sched_tick(), for aging
+enum sched_policy sched_policy = SCHED_RR;
+_Static_assert(NPRIO <= 32, "ready_bitmap has one bit per priority level");
+
+static pidtype proc_create(proc_entry_t entry, const void *arg, const char *name, size_t stack_size);
+static void proc_reap(pidtype pid);
+static void sleep_remove(pidtype pid);
+void on_process_end(void);
+
+// Every switched-out process is parked on the same frame, whether it was preempted by the
+// timer or gave the CPU up: pusha registers above an interrupt frame (EIP, CS, EFLAGS), so
+// resuming it is always popa; iret.
+// Initial frame of a new process, from its lowest word up: popa dummies, an interrupt frame
+// that enters `entry` with interrupts enabled, then on_process_end as entry's return address
+// and the argument.
+#define FRAME_WORDS 13
+#define FRAME_ENTRY 8
+#define FRAME_ARG 12
+#define KERNEL_CS 0x08
+static const uintptr_t frame_template[FRAME_WORDS] = {
+  0, 0, 0, 0, 0, 0, 0, 0,
+  0,                          // Entry, patched at spawn
+  KERNEL_CS,
+  0x202,
+  (uintptr_t)on_process_end,  // Safety net if entry returns
+  0                           // Argument, patched at spawn
+};
+
+// Set while the timer interrupt runs the scheduler: the interrupted process's frame, and after
+// a switch the frame of the process to resume, which timer_stub irets onto
+static uintptr_t *irq_frame = NULL;
+static pidtype irq_pid = 255; // Process the timer interrupted, whose stack the handler runs on
+
+// Set by preempt_check() for the reshed() it starts: the switch it makes, like any on the timer
+// path, counts as involuntary. Cleared by the next switch_process().
+static int preempting = 0;
+
+// One bit per proc_table slot, set while the slot is in use (PROC_FREE slots are clear)
+static bitmap256 pid_map;
+_Static_assert(NPROC <= 256, "pid_map tracks at most 256 processes");
+
+static void pid_release(pidtype pid) {
+  uintptr_t flags = irq_save();
+  bitmap_clear(&pid_map, pid);
+  irq_restore(flags);
+}
+
+// Default-size stacks of reaped processes, kept for the next spawns. Reaping runs with
+// interrupts off, so it only parks the stack on dirty_stacks; the null process later repaints
+// it and rebuilds the frame (proc_scrub_stacks), moving it to
+// spare_stacks. A spawn from there only patches entry and arg. Lower spare_stack_limit to 0 to
+// turn recycling off.
+#define SPARE_STACKS 8
+static void *spare_stacks[SPARE_STACKS];
+static unsigned int spare_count = 0;
+static void *dirty_stacks[SPARE_STACKS];
+static unsigned int dirty_count = 0;
+unsigned int spare_stack_limit = SPARE_STACKS;
 
 pidtype get_next_node(pidtype pid) {
     return proc_nodes[pid].after;
@@ -30,113 +95,550 @@ static void node_append_before(pidtype pid, pidtype move_before) {
   proc_nodes[move_before].before = pid;
 }
 
-// remove a node from the linked list
+// --- Fair class (SCHED_FAIR) ---
+//
+// Every READY process above the idle level sits in a binary min-heap keyed by virtual runtime.
+// The running process is charged vr_inc per tick, which is inversely proportional to the weight
+// of its nice value, so over time each process gets CPU in proportion to its weight. The
+// process with the least vruntime runs next; it takes over from the running one once the gap
+// exceeds fair_gran (half a time slice of a nice-0 process), which keeps switching rare.
+#define NICE_MIN (-20)
+#define NICE_MAX 19
+#define NICE_0_WEIGHT 1024
+#define NO_POS 255
+
+// Weight of each nice value (-20 .. 19): each step is about 10% more or less CPU
+static const uint32_t nice_weights[NICE_MAX - NICE_MIN + 1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+
+static pidtype fair_heap[NPROC];
+static uint8_t fair_pos[NPROC]; // Index in fair_heap, or NO_POS
+static unsigned int fair_count = 0;
+static uint32_t min_vruntime = 0; // Never decreases; new and woken processes start here
+static uint32_t fair_gran = NICE_0_WEIGHT;
+
+// vruntime wraps: compare by signed distance
+static inline int vr_before(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) < 0;
+}
+
+static inline int fair_less(unsigned int i, unsigned int j) {
+  return vr_before(proc_table[fair_heap[i]].vruntime, proc_table[fair_heap[j]].vruntime);
+}
+
+static void fair_swap(unsigned int i, unsigned int j) {
+  pidtype a = fair_heap[i];
+  fair_heap[i] = fair_heap[j];
+  fair_heap[j] = a;
+  fair_pos[fair_heap[i]] = i;
+  fair_pos[fair_heap[j]] = j;
+}
+
+static void fair_sift_up(unsigned int i) {
+  while (i > 0 && fair_less(i, (i - 1) / 2)) {
+    fair_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void fair_sift_down(unsigned int i) {
+  while (1) {
+    unsigned int least = i;
+    unsigned int left = 2 * i + 1;
+    if (left < fair_count && fair_less(left, least)) least = left;
+    if (left + 1 < fair_count && fair_less(left + 1, least)) least = left + 1;
+    if (least == i) return;
+    fair_swap(i, least);
+    i = least;
+  }
+}
+
+static inline int fair_class(pidtype pid) {
+  return sched_policy == SCHED_FAIR && proc_table[pid].base_prio != PRIO_IDLE;
+}
+
+static void fair_insert(pidtype pid) {
+  // A process that slept does not bank credit: it rejoins no further back than min_vruntime
+  if (vr_before(proc_table[pid].vruntime, min_vruntime)) {
+    proc_table[pid].vruntime = min_vruntime;
+  }
+  fair_heap[fair_count] = pid;
+  fair_pos[pid] = fair_count;
+  fair_sift_up(fair_count++);
+}
+
+static void fair_remove(pidtype pid) {
+  unsigned int i = fair_pos[pid];
+  fair_pos[pid] = NO_POS;
+  if (i != --fair_count) {
+    // Fill the hole with the last entry, which may belong above or below it
+    pidtype moved = fair_heap[fair_count];
+    fair_heap[i] = moved;
+    fair_pos[moved] = i;
+    fair_sift_up(i);
+    fair_sift_down(fair_pos[moved]);
+  }
+}
+
+// Advance min_vruntime to the least vruntime among the running and READY fair processes
+static void fair_update_min(void) {
+  int have = 0;
+  uint32_t least = 0;
+  if (current_pid != 255 && proc_table[current_pid].state == PROC_CURRENT && fair_class(current_pid)) {
+    least = proc_table[current_pid].vruntime;
+    have = 1;
+  }
+  if (fair_count > 0 && (!have || vr_before(proc_table[fair_heap[0]].vruntime, least))) {
+    least = proc_table[fair_heap[0]].vruntime;
+    have = 1;
+  }
+  if (have && vr_before(min_vruntime, least)) {
+    min_vruntime = least;
+  }
+}
+
+int setnice(pidtype pid, int nice) {
+  if (pid >= NPROC || nice < NICE_MIN || nice > NICE_MAX) {
+    return -128;
+  }
+  uintptr_t flags = irq_save();
+  if (proc_table[pid].state == PROC_FREE || proc_table[pid].state == PROC_TERMINATED) {
+    irq_restore(flags);
+    return -128;
+  }
+  int old = proc_table[pid].nice;
+  proc_table[pid].nice = (int8_t)nice;
+  proc_table[pid].vr_inc = (NICE_0_WEIGHT * NICE_0_WEIGHT) / nice_weights[nice - NICE_MIN];
+  irq_restore(flags);
+  return old;
+}
+
+int getnice(pidtype pid) {
+  if (pid >= NPROC || proc_table[pid].state == PROC_FREE) {
+    return -128;
+  }
+  return proc_table[pid].nice;
+}
+
+// Remove a READY process from its level's ready queue (or from the fair heap)
 void node_remove(pidtype pid) {
+    if (fair_pos[pid] != NO_POS) {
+        fair_remove(pid);
+        return;
+    }
+
+    uint8_t prio = proc_table[pid].prio;
     pidtype prev = proc_nodes[pid].before;
     pidtype next = proc_nodes[pid].after;
 
     if (pid == next) {
-        // Only one element in the list
-        ready_list = 255;
+        // Only one element in the queue
+        ready_queues[prio] = 255;
+        ready_bitmap &= ~(1U << prio);
     } else {
         proc_nodes[prev].after = next;
         proc_nodes[next].before = prev;
         
-        // Update ready_list head if we removed the head
-        if (ready_list == pid) {
-            ready_list = next;
+        // Update the queue head if we removed the head
+        if (ready_queues[prio] == pid) {
+            ready_queues[prio] = next;
         }
     }
 }
 
 uint8_t current_pid = 255;
-const size_t STACK_SIZE = 4096;
 
 pidtype getpid(void) {
     return current_pid;
 }
 
-// Round-robin with lazy zombie cleanup
+// Highest priority level with a READY process, or -1 if none
+static inline int ready_top(void) {
+  return ready_bitmap ? 31 - __builtin_clz(ready_bitmap) : -1;
+}
+
+// Run the head of the highest non-empty level: one bit scan, whatever the number of processes.
+// A running process keeps the CPU against lower levels and goes behind its equals (round-robin).
+// Under SCHED_FAIR the heap top (least vruntime) runs instead, ahead of the idle level.
 static void switch_to_next_process(void) {
-  if (ready_list == 255) return;
+  int running = current_pid != 255 && proc_table[current_pid].state == PROC_CURRENT;
+  pidtype next;
 
-  // Start checking from the next node
-  pidtype curr = get_next_node(current_pid);
-  if (curr == 255) curr = ready_list; // Fallback if current_pid wasn't in list
+  if (fair_count > 0) {
+    if (running && fair_class(current_pid) &&
+        !vr_before(proc_table[fair_heap[0]].vruntime, proc_table[current_pid].vruntime)) {
+      return; // Nobody is owed more CPU than we are
+    }
+    next = fair_heap[0];
+  } else {
+    int top = ready_top();
+    if (top < 0) return;
+    if (running && proc_table[current_pid].prio > top) return;
+    next = ready_queues[top];
+  }
 
-  pidtype start_check = curr;
-  
-  while (1) {
-      if (proc_table[curr].state == PROC_TERMINATED) {
-          // Process is terminated, proceed with cleanup
-          
-          // Safety: Don't clean our own stack while running on it
-          if (curr != current_pid) {
-              pidtype to_clean = curr;
-              curr = get_next_node(curr); // Advance curr before unlinking
-              
-              node_remove(to_clean);
-              free_stack(proc_table[to_clean].stackbase);
-              proc_table[to_clean].state = PROC_FREE;
-              
-              kdebug_puts("[INFO] Cleanup complete for PID ");
-              // kdebug_puthex(to_clean);
-              kdebug_puts("\n");
-              
-              if (ready_list == 255) return; // List became empty
-              // If we looped back to start because of removal, update start
-              if (to_clean == start_check) start_check = curr;
-              
-              continue; // Continue loop with new curr
-          }
-      }
+  node_remove(next);
+  if (running) append_on_ready_list(current_pid);
+  switch_process(next);
+}
 
-      if (proc_table[curr].state == PROC_READY) {
-          switch_process(curr);
-          return;
-      }
+// A process that killed itself was still running on its stack; it is freed by the
+// next reshed() that runs on another stack. At most one is ever pending.
+static pidtype zombie = 255;
 
-      curr = get_next_node(curr);
-      
-      // Full circle check
-      if (curr == start_check) {
-          // No ready process found (all might be suspended or current is the only one)
-          return;
-      }
+static void reap_zombie(void) {
+  // On the timer path the interrupted process's stack stays in use until timer_stub irets,
+  // even after a switch changed current_pid
+  if (zombie != 255 && zombie != current_pid && zombie != irq_pid) {
+    proc_reap(zombie);
+    zombie = 255;
   }
 }
 
 void reshed(void) {
     //kdebug_puts("\n[DEBUG] reshed called\n");
-    __asm__ volatile("cli");
+    // Interrupts stay off if they were: the timer interrupt reschedules too
+    uintptr_t flags = irq_save();
+    reap_zombie();
     switch_to_next_process();
-    __asm__ volatile("sti");
+    irq_restore(flags);
+}
+
+// Charge the time since the last accounting event to the process's bucket, then switch bucket
+static void acct_enter(pidtype pid, uint8_t bucket) {
+  struct Procent *p = &proc_table[pid];
+  uint64_t now = rdtsc();
+  p->stats.cycles[p->acct_state] += now - p->acct_stamp;
+  p->acct_state = bucket;
+  p->acct_stamp = now;
 }
 
+// Queue a process at the tail of its level (or in the fair heap)
 void append_on_ready_list(pidtype pid) {
   if (pid == 255)
     return;
-  if (ready_list == 255) {
-    // List is empty, initialize single-node circle
-    ready_list = pid;
+  acct_enter(pid, ACCT_READY);
+  if (fair_class(pid)) {
+    fair_insert(pid);
+    return;
+  }
+  uint8_t prio = proc_table[pid].prio;
+  proc_table[pid].ready_since = sched_ticks;
+  if (ready_queues[prio] == 255) {
+    // Queue is empty, initialize single-node circle
+    ready_queues[prio] = pid;
     proc_nodes[pid].before = pid;
     proc_nodes[pid].after = pid;
+    ready_bitmap |= (1U << prio);
   } else {
-    // Insert before the current head (ready_list)
-    node_append_before(pid, ready_list);
-    ready_list = pid;
+    // Just before the head is the tail of the circle
+    node_append_before(pid, ready_queues[prio]);
+  }
+}
+
+// True if a READY process should take the CPU from the running one right away
+static int outranked(void) {
+  if (fair_count > 0) {
+    // The idle process yields to any fair process; a fair one to a process well behind it
+    return !fair_class(current_pid) ||
+           vr_before(proc_table[fair_heap[0]].vruntime + fair_gran, proc_table[current_pid].vruntime);
+  }
+  return ready_top() > proc_table[current_pid].prio;
+}
+
+void preempt_check(void) {
+  if (current_pid != 255 && outranked()) {
+    preempting = 1;
+    reshed();
+    preempting = 0; // In case reshed() found nothing to switch to
   }
 }
 
+void ready_process(pidtype pid) {
+  proc_table[pid].state = PROC_READY;
+  append_on_ready_list(pid);
+  preempt_check();
+}
+
+// Move a process to another level, requeueing it if it is READY. Caller has interrupts disabled.
+static void set_level(pidtype pid, uint8_t level) {
+  if (proc_table[pid].state == PROC_READY) {
+    node_remove(pid);
+    proc_table[pid].prio = level;
+    append_on_ready_list(pid);
+  } else {
+    proc_table[pid].prio = level;
+  }
+}
+
+int chprio(pidtype pid, uint8_t prio) {
+  if (pid >= NPROC || prio >= NPRIO) {
+    return -1;
+  }
+  uintptr_t flags = irq_save();
+  uint8_t state = proc_table[pid].state;
+  if (state == PROC_FREE || state == PROC_TERMINATED) {
+    irq_restore(flags);
+    return -1;
+  }
+  int old = proc_table[pid].base_prio;
+  proc_table[pid].base_prio = prio;
+  proc_table[pid].ticks_used = 0;
+  set_level(pid, prio);
+  irq_restore(flags);
+
+  // A raised READY process or a lowered running one may now have to take over
+  preempt_check();
+  return old;
+}
+
+int getprio(pidtype pid) {
+  if (pid >= NPROC || proc_table[pid].state == PROC_FREE) {
+    return -1;
+  }
+  return proc_table[pid].base_prio;
+}
+
+// --- Scheduling policy ---
+//
+// SCHED_RR: every process stays at its base priority and equals share the CPU in quanta of
+// one time slice.
+// SCHED_MLFQ: a process that uses its whole quantum sinks one level (at most MLFQ_LEVELS - 1
+// below its base) and gets a quantum twice as long there; one that blocks in receive() or
+// sem_wait() climbs one level back. Interactive and IPC-bound processes therefore stay above
+// CPU-bound ones and run as soon as they wake. Aging: a READY process that has waited
+// MLFQ_STARVE_TICKS without running is lifted back to its base level.
+#define MLFQ_LEVELS 4
+#define MLFQ_AGING_TICKS 50   // How often the aging scan runs (0.5s at 100 Hz)
+#define MLFQ_STARVE_TICKS 100 // Wait that counts as starving (1s)
+
+// Lowest level MLFQ may push a process to. Level 0 stays reserved for the idle process.
+static uint8_t mlfq_floor(const struct Procent *p) {
+  if (p->base_prio < MLFQ_LEVELS) {
+    return p->base_prio ? 1 : 0;
+  }
+  return p->base_prio - (MLFQ_LEVELS - 1);
+}
+
+static void mlfq_age(void) {
+  for (int pid = 0; pid < NPROC; pid++) {
+    struct Procent *p = &proc_table[pid];
+    if (p->state == PROC_READY && p->prio < p->base_prio &&
+        sched_ticks - p->ready_since >= MLFQ_STARVE_TICKS) {
+      p->ticks_used = 0;
+      set_level(pid, p->base_prio);
+    }
+  }
+}
+
+void sched_set_policy(enum sched_policy policy) {
+  uintptr_t flags = irq_save();
+  sched_policy = policy;
+  // Start every process from its base level under the new policy
+  for (int pid = 0; pid < NPROC; pid++) {
+    if (proc_table[pid].state != PROC_FREE && proc_table[pid].state != PROC_TERMINATED) {
+      proc_table[pid].ticks_used = 0;
+      set_level(pid, proc_table[pid].base_prio);
+    }
+  }
+  irq_restore(flags);
+}
+
+void sched_tick(uint32_t slice) {
+  if (current_pid == 255) return;
+  sched_ticks++;
+
+  struct Procent *cur = &proc_table[current_pid];
+  if (fair_class(current_pid)) {
+    // Fair class: no fixed quantum, switch once someone is owed more than fair_gran
+    cur->vruntime += cur->vr_inc;
+    fair_gran = slice * NICE_0_WEIGHT / 2;
+    fair_update_min();
+    if (outranked()) {
+      reshed();
+    }
+    return;
+  }
+
+  if (sched_policy == SCHED_MLFQ && sched_ticks % MLFQ_AGING_TICKS == 0) {
+    mlfq_age();
+    preempt_check(); // A lifted process may outrank us now
+    if (cur != &proc_table[current_pid]) {
+      return; // Switched away: cur is queued now and its quantum restarts anyway
+    }
+  }
+
+  // Each level below the base doubles the quantum
+  if (++cur->ticks_used < (slice << (cur->base_prio - cur->prio))) {
+    preempt_check(); // A sleeper that just woke may outrank us
+    return;
+  }
+
+  // Quantum used up: CPU-bound, so sink a level under MLFQ, then let the next process run
+  cur->ticks_used = 0;
+  if (sched_policy == SCHED_MLFQ && cur->prio > mlfq_floor(cur)) {
+    cur->prio--; // Not queued while running: no requeue needed
+  }
+  reshed();
+}
+
+// --- Timed sleep ---
+// Sleepers sit in a delta list threaded through proc_nodes, ordered by wakeup time. Each
+// entry's sleep_delta counts the ticks after the one before it, so a tick only touches the head.
+static pidtype sleep_head = 255;
+
+// Queue pid to wake after `ticks` more tick boundaries. Caller has interrupts disabled.
+void sleep_insert(pidtype pid, uint32_t ticks) {
+  pidtype prev = 255;
+  pidtype curr = sleep_head;
+  while (curr != 255 && proc_table[curr].sleep_delta <= ticks) {
+    ticks -= proc_table[curr].sleep_delta;
+    prev = curr;
+    curr = proc_nodes[curr].after;
+  }
+  proc_table[pid].sleep_delta = ticks;
+  proc_nodes[pid].before = prev;
+  proc_nodes[pid].after = curr;
+  if (curr != 255) {
+    proc_table[curr].sleep_delta -= ticks;
+    proc_nodes[curr].before = pid;
+  }
+  if (prev != 255) {
+    proc_nodes[prev].after = pid;
+  } else {
+    sleep_head = pid;
+  }
+}
+
+static void sleep_remove(pidtype pid) {
+  pidtype prev = proc_nodes[pid].before;
+  pidtype next = proc_nodes[pid].after;
+  if (next != 255) {
+    proc_table[next].sleep_delta += proc_table[pid].sleep_delta; // Its wakeup time stays put
+    proc_nodes[next].before = prev;
+  }
+  if (prev != 255) {
+    proc_nodes[prev].after = next;
+  } else {
+    sleep_head = next;
+  }
+}
+
+int sleep_advance(uint32_t ticks) {
+  int woke = 0;
+  while (sleep_head != 255) {
+    pidtype pid = sleep_head;
+    if (proc_table[pid].sleep_delta > ticks) {
+      proc_table[pid].sleep_delta -= ticks;
+      break;
+    }
+    ticks -= proc_table[pid].sleep_delta;
+    sleep_head = proc_nodes[pid].after;
+    if (sleep_head != 255) proc_nodes[sleep_head].before = 255;
+
+    // No reschedule here: the caller is mid-interrupt, sched_tick() or the idle loop does it
+    proc_table[pid].state = PROC_READY;
+    append_on_ready_list(pid);
+    woke++;
+  }
+  return woke;
+}
+
+uint32_t sleep_next_deadline(void) {
+  return sleep_head == 255 ? TIMER_NO_DEADLINE : proc_table[sleep_head].sleep_delta;
+}
+
+int sleep_ticks(uint32_t ticks) {
+  if (current_pid == 255) return -1;
+  if (ticks == 0) {
+    reshed();
+    return 0;
+  }
+  // The current tick is partly gone: wait one more boundary so we never wake early
+  if (ticks < 0xFFFFFFFFu) ticks++;
+  __asm__ volatile("cli");
+  sleep_insert(current_pid, ticks);
+  block_current(PROC_SLEEPING);
+  __asm__ volatile("sti");
+  return 0;
+}
+
+int sleep_ms(uint32_t ms) {
+  // Round up to whole ticks, without overflowing for large ms
+  const uint32_t ms_per_tick = 1000 / TIMER_HZ;
+  return sleep_ticks(ms / ms_per_tick + (ms % ms_per_tick != 0));
+}
+
+// Mark the running process blocked in `state`, without rescheduling yet
+static void block_mark(uint8_t state) {
+  struct Procent *cur = &proc_table[current_pid];
+  cur->state = state;
+  // Gave the CPU up before its quantum ran out: interactive, so climb a level under MLFQ
+  if (sched_policy == SCHED_MLFQ && cur->prio < cur->base_prio) {
+    cur->prio++;
+  }
+  cur->ticks_used = 0;
+}
+
+void block_current(uint8_t state) {
+  block_mark(state);
+  reshed();
+}
+
+// Switch straight to `pid`, just woken by the running process, without a trip through the
+// ready queues: it runs the rest of the quantum, `used` ticks of which are gone. The running
+// process, if still runnable, goes behind its equals. Falls back to a normal wakeup when a
+// READY process outranks `pid`. Caller has interrupts disabled.
+static void handoff(pidtype pid, uint32_t used) {
+  struct Procent *next = &proc_table[pid];
+  int ok = sched_policy == SCHED_FAIR ? fair_class(pid) : ready_top() <= next->prio;
+  next->state = PROC_READY;
+  if (!ok) {
+    append_on_ready_list(pid);
+    reshed();
+    return;
+  }
+  // As in fair_insert(): no credit banked while blocked
+  if (fair_class(pid) && vr_before(next->vruntime, min_vruntime)) {
+    next->vruntime = min_vruntime;
+  }
+  next->ticks_used = used;
+  if (proc_table[current_pid].state == PROC_CURRENT) {
+    append_on_ready_list(current_pid);
+  }
+  switch_process(pid);
+}
+
 static void null_process(void *arg) {
   (void)arg;
-  while(1) reshed();
+  while(1) {
+    heap_reclaim(); // Frees other processes made into the kernel arena
+    proc_scrub_stacks(); // Get reaped stacks ready for the next spawns
+
+    // Nothing else runnable: halt until an interrupt instead of spinning through reshed()
+    __asm__ volatile("cli");
+    if (ready_bitmap == 0 && fair_count == 0) {
+      timer_idle(sleep_next_deadline()); // Wake in time for the first sleeper
+    }
+    __asm__ volatile("sti");
+    reshed();
+  }
 }
 
 static void init_proc_table() {
+  pid_map = (bitmap256){0};
   for (int i = 0; i < NPROC; i++) {
     proc_table[i].state = PROC_FREE;
     proc_table[i].pid = i;
+    proc_table[i].heap = NULL;
   }
 }
 
@@ -145,39 +647,165 @@ static void init_proc_nodes() {
     proc_nodes[i].after = i;
     proc_nodes[i].before = i;
   }
+  for (int i = 0; i < NPRIO; i++) {
+    ready_queues[i] = 255;
+  }
+  ready_bitmap = 0;
+  for (int i = 0; i < NPROC; i++) {
+    fair_pos[i] = NO_POS;
+  }
+  fair_count = 0;
 }
 
 void init_proc(void) {
   init_proc_nodes();
   init_proc_table();
   create_process(null_process, NULL, "null_process");
+  chprio(0, PRIO_IDLE); // Runs only when nothing else is ready
 }
 
-// Wrapper: Create a process and append it to the ready list
+// Wrapper: Create a process and make it ready at PRIO_DEFAULT
 pidtype create_process(proc_entry_t entry, const void *arg, const char *name) {
+  return create_process_stack(entry, arg, name, STACK_DEFAULT_SIZE);
+}
+
+pidtype create_process_stack(proc_entry_t entry, const void *arg, const char *name, size_t stack_size) {
   kdebug_puts("[INFO] create_process: ");
   kdebug_puts(name);
   kdebug_puts("\n");
-  uint8_t pid = proc_create(entry, arg, name);
+  uint8_t pid = proc_create(entry, arg, name, stack_size);
   if (pid != 255) {
-    append_on_ready_list(pid);
+    uintptr_t flags = irq_save();
+    ready_process(pid);
+    irq_restore(flags);
   }
   return pid;
 }
 
+static void frame_init(void *stack, size_t stack_size) {
+  memcpy((uint8_t *)stack + stack_size - sizeof(frame_template), frame_template, sizeof(frame_template));
+}
+
+// Keep a dead process's stack for the next spawn, or give it back to the stack pool.
+// Interrupts may be off: only the pointer is parked, proc_scrub_stacks() does the rest.
+static void stack_recycle(void *stack, size_t stack_size) {
+  if (stack_size == STACK_DEFAULT_SIZE) {
+    uintptr_t flags = irq_save();
+    if (spare_count + dirty_count < spare_stack_limit) {
+      dirty_stacks[dirty_count++] = stack;
+      stack = NULL;
+    }
+    irq_restore(flags);
+    if (stack == NULL) return;
+  }
+  free_stack(stack);
+}
+
+// Make a reaped stack ready to run: fresh paint and the initial frame. Painting all of it is a
+// single memset, cheaper than finding how deep the last owner went word by word.
+static void stack_scrub(void *stack, size_t stack_size) {
+  stack_paint(stack, stack_size);
+  frame_init(stack, stack_size);
+}
+
+// Called by the null process, with interrupts enabled: scrub the parked stacks.
+void proc_scrub_stacks(void) {
+  while (1) {
+    void *stack = NULL;
+    uintptr_t flags = irq_save();
+    if (dirty_count > 0) {
+      stack = dirty_stacks[--dirty_count];
+    }
+    irq_restore(flags);
+    if (stack == NULL) return;
+
+    stack_scrub(stack, STACK_DEFAULT_SIZE);
+
+    flags = irq_save();
+    if (spare_count + dirty_count < spare_stack_limit) {
+      spare_stacks[spare_count++] = stack;
+      stack = NULL;
+    }
+    irq_restore(flags);
+    if (stack != NULL) free_stack(stack);
+  }
+}
+
+// A recycled default-size stack, or NULL. *ready says whether it is already scrubbed.
+static void *stack_reuse(size_t stack_size, int *ready) {
+  void *stack = NULL;
+  *ready = 0;
+  if (stack_size == STACK_DEFAULT_SIZE) {
+    uintptr_t flags = irq_save();
+    if (spare_count > 0) {
+      stack = spare_stacks[--spare_count];
+      *ready = 1;
+    } else if (dirty_count > 0) {
+      stack = dirty_stacks[--dirty_count];
+    }
+    irq_restore(flags);
+  }
+  return stack;
+}
+
+// Free a terminated process's stack, heap arena and table slot. It must already be off every
+// scheduler list, and must not be the process whose stack we are running on.
+static void proc_reap(pidtype pid) {
+  if (pid >= NPROC || pid == current_pid || proc_table[pid].state != PROC_TERMINATED) {
+    klog_error("proc_reap: process is not a reapable zombie");
+    return;
+  }
+  stack_recycle(proc_table[pid].stackbase, proc_table[pid].stacksize);
+  heap_release(pid);
+  fpu_release(pid);
+  proc_table[pid].state = PROC_FREE;
+  pid_release(pid);
+
+  kdebug_puts("[INFO] Cleanup complete for PID ");
+  kdebug_puthex(pid);
+  kdebug_puts("\n");
+}
+
 int kill(pidtype pid) {
     if (pid == 0) {
         klog_error("kill: null_process can't be terminated");
         return -1;
     }
-    
-    if (pid >= NPROC || proc_table[pid].state == PROC_FREE) {
+    if (pid >= NPROC) {
+        return -1;
+    }
+
+    uintptr_t flags = irq_save();
+    uint8_t state = proc_table[pid].state;
+    if (state == PROC_FREE || state == PROC_TERMINATED) {
+        irq_restore(flags);
         return -1;
     }
 
+    // Unlink from whichever list holds it, so the scheduler never sees it again
+    // (the running process is in none)
+    if (state == PROC_READY) {
+        node_remove(pid);
+    } else if (state == PROC_WAITING) {
+        sem_cancel_wait(pid);
+    } else if (state == PROC_SLEEPING) {
+        sleep_remove(pid);
+    }
     proc_table[pid].state = PROC_TERMINATED;
+
+    if (pid != current_pid) {
+        // Its stack is idle: free everything now
+        proc_reap(pid);
+        irq_restore(flags);
+        return 0;
+    }
+
+    // Killing ourselves: the stack stays in use until we switch away
+    reap_zombie();
+    zombie = pid;
+    irq_restore(flags);
     reshed();
-    return 0;
+    return 0; // Not reached
 }
 
 // Safety net: called if a process mistakenly returns.
@@ -185,42 +813,60 @@ void on_process_end(void) {
     kill(getpid());
 }
 
-static pidtype proc_create(proc_entry_t entry, const void *arg, const char *name) {
-  /* Find a free slot */
-  int pid = -1;
-  for (int i = 0; i < NPROC; i++) {
-    if (proc_table[i].state == PROC_FREE) {
-      pid = i;
-      break;
-    }
+static pidtype proc_create(proc_entry_t entry, const void *arg, const char *name, size_t stack_size) {
+  /* Claim a free slot: lowest clear bit of pid_map */
+  uintptr_t flags = irq_save();
+  int pid = bitmap_first_zero(&pid_map);
+  if (pid >= 0 && pid < NPROC) {
+    bitmap_set(&pid_map, (uint16_t)pid);
+  } else {
+    pid = -1;
   }
+  irq_restore(flags);
 
   if (pid == -1) {
     klog_error("proc_create: no free process slots");
     return 255;
   }
 
-  void *stack = alloc_stack(STACK_SIZE);
+  stack_size = stack_round_size(stack_size);
+  int ready = 0;
+  void *stack = stack_size ? stack_reuse(stack_size, &ready) : NULL;
+  if (stack && !ready) {
+    stack_scrub(stack, stack_size); // Reaped since the null process last ran
+  } else if (!stack && stack_size) {
+    stack = alloc_stack(stack_size);
+    if (stack) {
+      // Paint the whole stack so its high-water mark can be measured later
+      stack_paint(stack, stack_size);
+      frame_init(stack, stack_size);
+    }
+  }
   if (!stack) {
     klog_error("proc_create: stack allocation failed");
+    pid_release(pid);
     return 255;
   }
 
   proc_table[pid].state = PROC_READY;
+  proc_table[pid].prio = PRIO_DEFAULT;
+  proc_table[pid].base_prio = PRIO_DEFAULT;
+  proc_table[pid].ticks_used = 0;
+  proc_table[pid].nice = 0;
+  proc_table[pid].vr_inc = NICE_0_WEIGHT;
+  proc_table[pid].vruntime = min_vruntime;
+  memset(&proc_table[pid].stats, 0, sizeof(proc_table[pid].stats));
+  proc_table[pid].acct_state = ACCT_READY;
+  proc_table[pid].acct_stamp = rdtsc();
   proc_table[pid].stackbase = stack;
+  proc_table[pid].stacksize = stack_size;
+  proc_table[pid].heap = NULL;
+  proc_table[pid].fpu_state = NULL;
 
-  /* Prepare initial stack frame */
-  uintptr_t *sp = (uintptr_t *)((uint8_t *)stack + STACK_SIZE);
-
-  *(--sp) = (uintptr_t)arg;           // Argument
-  *(--sp) = (uintptr_t)on_process_end; // RETURN ADDRESS (Safety Net)
-  *(--sp) = (uintptr_t)entry;          // Initial EIP
-  *(--sp) = 0x202;                     // EFLAGS (Interrupts enabled)
-
-  /* Push dummy registers for popa */
-  for (int i = 0; i < 8; i++) {
-    *(--sp) = 0;
-  }
+  /* The frame template is in place: only entry and arg differ per process */
+  uintptr_t *sp = (uintptr_t *)((uint8_t *)stack + stack_size) - FRAME_WORDS;
+  sp[FRAME_ENTRY] = (uintptr_t)entry;
+  sp[FRAME_ARG] = (uintptr_t)arg;
 
   proc_table[pid].stackptr = sp;
   strcpy(proc_table[pid].name, name);
@@ -228,13 +874,16 @@ static pidtype proc_create(proc_entry_t entry, const void *arg, const char *name
 
   // IPC Init
   proc_table[pid].has_message = 0;
+  proc_table[pid].msg_from = 255;
+  proc_table[pid].wait_from = 255;
 
   return pid;
 }
 
 void run_null_process(void) {
   kdebug_puts("[INFO] run_null_process: jumping to PID 0\n");
-  /* Switch to PID 0 (the null process created in init_proc) */
+  /* Switch to PID 0 (the null process created in init_proc); the running process is never queued */
+  node_remove(0);
   switch_process(0);
 }
 
@@ -248,18 +897,21 @@ void switch_process(pidtype next_pid) {
   if (current_pid == 255) {
     current_pid = next_pid;
     proc_table[next_pid].state = PROC_CURRENT;
+    acct_enter(next_pid, ACCT_RUN);
+    fpu_switch(next_pid);
     uintptr_t *sp = proc_table[next_pid].stackptr;
 
     __asm__ volatile("mov %0, %%esp \n\t"
                      "popa          \n\t"
-                     "popf          \n\t"
-                     "ret           \n\t"
+                     "iret          \n\t"
                      :
                      : "r"(sp)
                      : "memory");
     __builtin_unreachable();
   }
 
+  int involuntary = irq_frame != NULL || preempting;
+  preempting = 0;
   if (next_pid == current_pid)
     return;
 
@@ -272,63 +924,321 @@ void switch_process(pidtype next_pid) {
   // Also check if we are WAITING (semaphore block)
   if (proc_table[prev_pid].state == PROC_CURRENT) {
       proc_table[prev_pid].state = PROC_READY;
+      if (involuntary) {
+          proc_table[prev_pid].stats.nivcsw++;
+      } else {
+          proc_table[prev_pid].stats.nvcsw++; // Gave the CPU up while still runnable
+      }
+      acct_enter(prev_pid, ACCT_READY);
+  } else {
+      proc_table[prev_pid].stats.nvcsw++;
+      acct_enter(prev_pid, ACCT_BLOCKED);
   }
 
   proc_table[next_pid].state = PROC_CURRENT;
+  acct_enter(next_pid, ACCT_RUN);
+
+  // Early overflow warning: the outgoing process ran its stack down into the canary.
+  // Repaint it so the next warning means a new overflow, not the same one.
+  if (!stack_canary_ok(proc_table[prev_pid].stackbase)) {
+    klog_error("switch_process: stack canary overwritten, stack overflow");
+    klog_error(proc_table[prev_pid].name);
+    stack_paint(proc_table[prev_pid].stackbase, STACK_CANARY_SIZE);
+  }
+
+  // FPU registers stay put; the next process traps on first use unless they are its own
+  fpu_switch(next_pid);
+
+  // Preempted by the timer: the interrupted frame is already complete, so just swap frames
+  // and let timer_stub iret onto the next process. Nothing is nested on either stack.
+  if (irq_frame) {
+    proc_table[prev_pid].stackptr = irq_frame;
+    irq_frame = proc_table[next_pid].stackptr;
+    return;
+  }
 
   /*
    * Inline Context Switch
-   * We save current state and load the next state.
+   * Build the same frame an interrupt would (EFLAGS, CS, resumption address, registers)
+   * and resume the next process through it.
    */
   __asm__ volatile(
-      "pushl $1f      \n\t" // Push resumption address
       "pushf          \n\t" // Save current flags
+      "pushl %%cs     \n\t"
+      "pushl $1f      \n\t" // Push resumption address
       "pusha          \n\t" // Save all registers
       "movl %%esp, %0 \n\t" // Store current ESP
       "movl %1, %%esp \n\t" // Load next ESP
       "popa           \n\t"
-      "popf           \n\t" // Restores flags
-      "ret            \n\t" // Jump to resumption point OR process entry
+      "iret           \n\t" // Restores flags; jumps to resumption point OR process entry
       "1:             \n\t" // Resumption point
       : "=m"(proc_table[prev_pid].stackptr)
       : "m"(proc_table[next_pid].stackptr)
       : "memory");
 }
 
+void sched_irq_enter(uintptr_t *frame) {
+  irq_frame = frame;
+  irq_pid = current_pid;
+}
+
+uintptr_t *sched_irq_exit(void) {
+  uintptr_t *frame = irq_frame;
+  irq_frame = NULL;
+  irq_pid = 255;
+  return frame;
+}
+
+size_t proc_stack_high_water(pidtype pid) {
+  if (pid >= NPROC) return 0;
+  // The process could be reaped (and its stack freed) while we scan
+  uintptr_t flags = irq_save();
+  size_t used = 0;
+  if (proc_table[pid].state != PROC_FREE) {
+    used = stack_high_water(proc_table[pid].stackbase, proc_table[pid].stacksize);
+  }
+  irq_restore(flags);
+  return used;
+}
+
+void proc_stack_report(void) {
+  serial_puts("[STACK] ---- stack high-water marks ----\n");
+  for (int pid = 0; pid < NPROC; pid++) {
+    // Read the entry with interrupts off, print it with them on: serial output is slow
+    uintptr_t flags = irq_save();
+    int live = proc_table[pid].state != PROC_FREE;
+    size_t used = 0, size = 0;
+    int canary_ok = 1;
+    char name[16];
+    if (live) {
+      used = stack_high_water(proc_table[pid].stackbase, proc_table[pid].stacksize);
+      size = proc_table[pid].stacksize;
+      canary_ok = stack_canary_ok(proc_table[pid].stackbase);
+      memcpy(name, proc_table[pid].name, sizeof(name));
+    }
+    irq_restore(flags);
+    if (!live) continue;
+
+    name[15] = '\0';
+    serial_puts("[STACK] pid=");
+    serial_print_hex(pid);
+    serial_puts(" used=");
+    serial_print_hex(used);
+    serial_puts(" size=");
+    serial_print_hex(size);
+    serial_puts(canary_ok ? " " : " OVERFLOW ");
+    serial_puts(name);
+    serial_puts("\n");
+  }
+}
+
+int proc_get_stats(pidtype pid, struct proc_stats *out) {
+  if (pid >= NPROC || out == NULL) return -1;
+  uintptr_t flags = irq_save();
+  struct Procent *p = &proc_table[pid];
+  if (p->state == PROC_FREE) {
+    irq_restore(flags);
+    return -1;
+  }
+  *out = p->stats;
+  out->cycles[p->acct_state] += rdtsc() - p->acct_stamp;
+  irq_restore(flags);
+  return 0;
+}
+
+static const char *const state_names[] = {
+  [PROC_FREE] = "free", [PROC_CURRENT] = "run", [PROC_READY] = "ready",
+  [PROC_RECV] = "recv", [PROC_WAITING] = "wait", [PROC_TERMINATED] = "dead",
+  [PROC_SLEEPING] = "sleep",
+};
+
+// Cycles in units of 1024, as printed by proc_ps()
+static inline uint32_t kcycles(uint64_t cycles) {
+  return (uint32_t)(cycles >> 10);
+}
+
+// Share of a process's lifetime spent running, in percent. There is no 64-bit division in
+// the kernel, so both sides are scaled down until the lifetime fits 25 bits.
+static uint32_t cpu_percent(const struct proc_stats *st) {
+  uint64_t life = st->cycles[ACCT_RUN] + st->cycles[ACCT_READY] + st->cycles[ACCT_BLOCKED];
+  unsigned int shift = 0;
+  while ((life >> shift) >= (1U << 25)) shift++;
+  uint32_t scaled = (uint32_t)(life >> shift);
+  return scaled ? (uint32_t)(st->cycles[ACCT_RUN] >> shift) * 100 / scaled : 0;
+}
+
+void proc_ps(void) {
+  struct proc_stats st;
+  serial_puts("[PS] ---- uptime ");
+  serial_print_hex(timer_ticks());
+  serial_puts(" ticks, times in Kcycles, cpu% of lifetime ----\n");
+  serial_puts("[PS] pid prio state cpu% run ready blocked vcsw ivcsw name\n");
+  for (int pid = 0; pid < NPROC; pid++) {
+    if (proc_get_stats(pid, &st) != 0) continue;
+    uint32_t pct = cpu_percent(&st);
+    uint8_t state = proc_table[pid].state;
+    serial_puts("[PS] ");
+    serial_print_hex(pid);
+    serial_puts(" ");
+    serial_print_hex(proc_table[pid].prio);
+    serial_puts(" ");
+    serial_puts(state <= PROC_SLEEPING ? state_names[state] : "?");
+    serial_puts(" ");
+    serial_print_hex(pct);
+    serial_puts(" ");
+    serial_print_hex(kcycles(st.cycles[ACCT_RUN]));
+    serial_puts(" ");
+    serial_print_hex(kcycles(st.cycles[ACCT_READY]));
+    serial_puts(" ");
+    serial_print_hex(kcycles(st.cycles[ACCT_BLOCKED]));
+    serial_puts(" ");
+    serial_print_hex(st.nvcsw);
+    serial_puts(" ");
+    serial_print_hex(st.nivcsw);
+    serial_puts(" ");
+    serial_puts(proc_table[pid].name);
+    serial_puts("\n");
+  }
+}
+
 // --- IPC Implementation ---
 
-// Send a message to a process
-// Returns 0 on success, -1 if pid invalid, 256 if buffer full (simple Xinu semantics usually return error)
-int send(pidtype pid, uint32_t msg) {
-    // Disable interrupts for atomicity
-    __asm__ volatile("cli");
-    
+// Put msg in a process's buffer. Caller has interrupts disabled.
+// Returns 0, -1 if pid is invalid, or -2 if its buffer is full (or it waits in call() for
+// a reply from someone else).
+static int msg_deposit(pidtype pid, uint32_t msg) {
     if (pid >= NPROC || proc_table[pid].state == PROC_FREE) {
-        __asm__ volatile("sti");
         return -1;
     }
 
     // Xinu semantics: If already has message, return error (non-blocking send)
     if (proc_table[pid].has_message) {
-        __asm__ volatile("sti");
         return -2; // Queue full
     }
+    if (proc_table[pid].wait_from != 255 && proc_table[pid].wait_from != current_pid) {
+        return -2; // Only the callee may answer a call()
+    }
 
     proc_table[pid].msg = msg;
     proc_table[pid].has_message = 1;
+    proc_table[pid].msg_from = current_pid;
+    return 0;
+}
+
+// Send a message to a process
+// Returns 0 on success, -1 if pid invalid, -2 if buffer full (simple Xinu semantics usually return error)
+int send(pidtype pid, uint32_t msg) {
+    // Disable interrupts for atomicity
+    uintptr_t flags = irq_save();
+
+    int err = msg_deposit(pid, msg);
 
     // If receiver was waiting for a message, wake it up
-    if (proc_table[pid].state == PROC_RECV) {
-        proc_table[pid].state = PROC_READY;
-        append_on_ready_list(pid);
-        // Reschedule to allow receiver to run immediately if priority is implemented
-        // In RR, it just joins the queue.
+    // (it runs at once if it outranks us, otherwise it joins its queue)
+    if (err == 0 && proc_table[pid].state == PROC_RECV) {
+        ready_process(pid);
     }
 
-    __asm__ volatile("sti");
+    irq_restore(flags);
+    return err;
+}
+
+// Send, and if the receiver is blocked in receive(), give it the CPU and the rest of our quantum
+int send_yield(pidtype pid, uint32_t msg) {
+    uintptr_t flags = irq_save();
+
+    int err = msg_deposit(pid, msg);
+    if (err == 0 && proc_table[pid].state == PROC_RECV && current_pid != 255) {
+        // We stay runnable, so a receiver below us must wait its turn like any wakeup
+        if (sched_policy != SCHED_FAIR && proc_table[pid].prio < proc_table[current_pid].prio) {
+            ready_process(pid);
+        } else {
+            handoff(pid, proc_table[current_pid].ticks_used);
+        }
+    }
+
+    irq_restore(flags);
+    return err;
+}
+
+// Block the running process until a message from `from` (255: anyone) is in its buffer.
+// `to` (or 255) was just sent a message: if that woke it, it runs at once in our place.
+// Caller has interrupts disabled.
+static void msg_wait(pidtype to, pidtype from) {
+    struct Procent *cur = &proc_table[current_pid];
+    int woke = to != 255 && proc_table[to].state == PROC_RECV;
+    if (cur->has_message) {
+        if (woke) ready_process(to); // Already have what we wait for: no need to block
+        return;
+    }
+
+    uint32_t used = cur->ticks_used;
+    cur->wait_from = from;
+    block_mark(PROC_RECV);
+    if (woke) {
+        handoff(to, used);
+    } else {
+        reshed();
+    }
+    cur->wait_from = 255;
+}
+
+// Send a request and block for the reply from pid. A receiver already waiting runs at once in
+// our place, so with a server answering by reply_recv() a round trip is two context switches
+// and never goes through the ready queues.
+int call(pidtype pid, uint32_t msg, uint32_t *reply) {
+    uintptr_t flags = irq_save();
+
+    if (current_pid == 255 || pid == current_pid) {
+        irq_restore(flags);
+        return -1; // No caller, or would wait for ourselves forever
+    }
+    struct Procent *cur = &proc_table[current_pid];
+    if (cur->has_message) {
+        irq_restore(flags);
+        return -3; // An unread message would be taken for the reply
+    }
+    int err = msg_deposit(pid, msg);
+    if (err != 0) {
+        irq_restore(flags);
+        return err;
+    }
+
+    msg_wait(pid, pid);
+
+    // --- We wake up here after the reply arrived ---
+    if (reply) *reply = cur->msg;
+    cur->has_message = 0;
+
+    irq_restore(flags);
     return 0;
 }
 
+// Server side of call(): answer pid, then block for the next request from anyone, handing the
+// CPU straight to the caller. Always returns with the next request, even if the reply could
+// not be delivered (the caller died), so a server loop never spins.
+int reply_recv(pidtype pid, uint32_t reply, uint32_t *next) {
+    uintptr_t flags = irq_save();
+
+    if (current_pid == 255) {
+        irq_restore(flags);
+        return -1;
+    }
+    struct Procent *cur = &proc_table[current_pid];
+    int err = pid == current_pid ? -1 : msg_deposit(pid, reply);
+    msg_wait(err == 0 ? pid : 255, 255);
+
+    if (next) *next = cur->msg;
+    cur->has_message = 0;
+
+    irq_restore(flags);
+    return err;
+}
+
+pidtype msg_sender(void) {
+    return current_pid == 255 ? 255 : proc_table[current_pid].msg_from;
+}
+
 // Receive a message (Blocks if empty)
 uint32_t receive(void) {
     __asm__ volatile("cli");
@@ -341,11 +1251,8 @@ uint32_t receive(void) {
         return msg;
     }
 
-    // No message: Block
-    proc_table[current_pid].state = PROC_RECV;
-    node_remove(current_pid); // Remove from ready list
-    
-    reshed(); // Yield CPU
+    // No message: Block (the running process is on no ready queue)
+    block_current(PROC_RECV); // Yield CPU
 
     // --- We wake up here after being made READY by send() ---
     
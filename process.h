@@ -2,6 +2,7 @@
 #define PROCESS_H
 
 #include "types.h"
+#include "proc_stats.h"
 
 #define NPROC (254)
 
@@ -18,19 +19,49 @@ enum proc_state {
     PROC_READY,
     PROC_WAITING,
     PROC_RECV,
-    PROC_TERMINATED
+    PROC_TERMINATED,
+    PROC_SLEEPING
 };
 
+// Priority levels: a READY process always runs before every process of a lower level, and
+// processes of one level share the CPU round-robin. Higher numbers run first.
+#define NPRIO 32
+#define PRIO_IDLE 0      // The null process
+#define PRIO_DEFAULT 16
+#define PRIO_MAX (NPRIO - 1)
+
+struct heap_arena;
+
 struct Procent {
     uint8_t pid;
     uint8_t state;
+    uint8_t prio;        // Current level: 0 (idle) .. PRIO_MAX
+    uint8_t base_prio;   // Level set by chprio(); MLFQ moves prio below it and back
+    uint32_t ticks_used; // Ticks run in the current quantum
+    uint32_t ready_since; // Scheduler tick when last queued, for aging
+    int8_t nice;         // SCHED_FAIR weight knob: -20 (most CPU) .. 19 (least)
+    uint32_t vr_inc;     // vruntime charged per tick, from nice
+    uint32_t vruntime;   // SCHED_FAIR virtual runtime
+    uint32_t sleep_delta; // PROC_SLEEPING: ticks after the previous sleeper wakes
+    uint8_t acct_state;  // ACCT_* bucket the time since acct_stamp goes to
+    uint64_t acct_stamp; // TSC when acct_state was entered
+    struct proc_stats stats;
     uintptr_t *stackptr;
     void *stackbase;
+    uint32_t stacksize;  // Bytes in the stack (its size class)
     char name[16];
     
     // Message Passing
     uint32_t msg; 
     int has_message;
+    pidtype msg_from;    // Sender of msg
+    pidtype wait_from;   // In call(): the only sender accepted, else 255
+
+    // Private heap arena (created on first malloc, released in bulk on cleanup)
+    struct heap_arena *heap;
+
+    // fxsave area (x87/SSE registers), allocated on first FPU use; see fpu.h
+    void *fpu_state;
 };
 
 extern struct Procent proc_table[NPROC];
@@ -38,14 +69,87 @@ extern struct Procent proc_table[NPROC];
 typedef void (*proc_entry_t)(void *);
 // Create a new process. Returns PID (0-15) or 255 on error.
 pidtype create_process(proc_entry_t entry, const void *arg, const char *name);
+// Same, with a stack of at least stack_size bytes (1KB .. 16KB, rounded up to a power of two).
+// Small I/O workers can run on 1KB; deep recursion needs more than the default 4KB.
+pidtype create_process_stack(proc_entry_t entry, const void *arg, const char *name, size_t stack_size);
+
+// Deepest stack use of a live process in bytes (stacks are painted at creation), 0 if invalid.
+size_t proc_stack_high_water(pidtype pid);
+// Print every live process's stack high-water mark and canary state on the serial port.
+void proc_stack_report(void);
+// Repaint and reframe the stacks of reaped processes kept for reuse, so a later spawn only
+// patches its entry and argument. Run by the null process; interrupts must be enabled.
+void proc_scrub_stacks(void);
+
+// Copy a process's CPU accounting, the current interval included, into *out.
+// Returns 0, or -1 if pid is invalid.
+int proc_get_stats(pidtype pid, struct proc_stats *out);
+// Print a ps-style table of every live process (CPU share, time per state, switches) on serial.
+void proc_ps(void);
 
 // IPC
 int send(pidtype pid, uint32_t msg);
 uint32_t receive(void);
+// send() that switches straight to a receiver blocked in receive(), donating the rest of the
+// quantum (unless the sender or a READY process outranks it). Returns like send().
+int send_yield(pidtype pid, uint32_t msg);
+// Synchronous request/reply: send msg, then block until pid replies into *reply, handing the
+// CPU directly to a waiting receiver. Messages from other senders are refused meanwhile.
+// Returns 0, send()'s error, or -3 if a message is already waiting (receive() it first).
+int call(pidtype pid, uint32_t msg, uint32_t *reply);
+// Server side: answer pid, then block for the next request (from anyone) into *next.
+// Always waits, even if the answer could not be delivered; returns 0 or send()'s error.
+int reply_recv(pidtype pid, uint32_t reply, uint32_t *next);
+// Sender of the last message the running process received
+pidtype msg_sender(void);
 
 extern struct ProcessNode proc_nodes[NPROC];
 void node_remove(pidtype pid);
 void append_on_ready_list(pidtype pid);
+// Mark a new or blocked process READY and queue it; switches to it at once if it outranks
+// the running process. Caller has interrupts disabled.
+void ready_process(pidtype pid);
+// Reschedule if a READY process outranks the running one.
+void preempt_check(void);
+
+// Set a process's base priority (0 .. PRIO_MAX). Returns the old one, or -1 on error.
+int chprio(pidtype pid, uint8_t prio);
+int getprio(pidtype pid);
+// Set a process's nice value (-20 .. 19), its CPU share under SCHED_FAIR.
+// Returns the old value, or -128 on error.
+int setnice(pidtype pid, int nice);
+int getnice(pidtype pid);
+
+// Scheduling policies, chosen at boot (kernel command line sched=rr, sched=mlfq or sched=fair)
+enum sched_policy {
+    SCHED_RR = 0, // Fixed priorities, round-robin within a level
+    SCHED_MLFQ,   // Multi-level feedback queue with aging
+    SCHED_FAIR    // Weighted fair share by virtual runtime (priorities above idle ignored)
+};
+extern enum sched_policy sched_policy;
+void sched_set_policy(enum sched_policy policy);
+// Timer tick: charges the running process and reschedules when its quantum of `slice`
+// ticks is used up.
+void sched_tick(uint32_t slice);
+// Sleep the running process for at least `ticks` timer ticks (10ms each) or `ms` milliseconds,
+// without using any CPU. 0 just yields. Returns 0, or -1 outside a process.
+int sleep_ticks(uint32_t ticks);
+int sleep_ms(uint32_t ms);
+// Timer: `ticks` ticks passed; makes every sleeper whose time is up READY (no reschedule).
+// Returns how many woke.
+int sleep_advance(uint32_t ticks);
+// Ticks until the first sleeper is due, or TIMER_NO_DEADLINE if none sleeps
+uint32_t sleep_next_deadline(void);
+
+// Timer interrupt scheduling: between sched_irq_enter(frame) and sched_irq_exit(), with `frame`
+// the interrupted process's saved registers and interrupt frame, a context switch only swaps
+// frames. sched_irq_exit() returns the frame to resume (popa; iret) and ends the section.
+void sched_irq_enter(uintptr_t *frame);
+uintptr_t *sched_irq_exit(void);
+
+// Block the running process in `state` (PROC_WAITING, PROC_RECV, ...) and reschedule.
+// Caller has interrupts disabled and has already queued it wherever it waits.
+void block_current(uint8_t state);
 
 extern uint8_t current_pid;
 void init_proc(void);
@@ -1,11 +1,17 @@
 #include "sem.h"
-#include "process.h" /* for proc_nodes, node_remove, append_on_ready_list */
+#include "process.h" /* for proc_nodes, append_on_ready_list, ready_process */
 #include "serial.h"
 #include "debug.h"
+#include "bitmap.h"
 
 struct sement sem_table[NSEM];
 
+// One bit per sem_table entry, set while it is in use
+static bitmap256 sem_map;
+_Static_assert(NSEM <= 256, "sem_map tracks at most 256 semaphores");
+
 void sem_init(void) {
+    sem_map = (bitmap256){0};
     for (int i = 0; i < NSEM; i++) {
         sem_table[i].state = SEM_FREE;
         sem_table[i].count = 0;
@@ -17,18 +23,18 @@ void sem_init(void) {
 
 int sem_create(int count) {
     __asm__ volatile("cli");
-    for (int i = 0; i < NSEM; i++) {
-        if (sem_table[i].state == SEM_FREE) {
-            sem_table[i].state = SEM_USED;
-            sem_table[i].count = count;
-            sem_table[i].head = 255;
-            sem_table[i].tail = 255;
-            __asm__ volatile("sti");
-            return i;
-        }
+    int i = bitmap_first_zero(&sem_map);
+    if (i < 0 || i >= NSEM) {
+        __asm__ volatile("sti");
+        return -1;
     }
+    bitmap_set(&sem_map, (uint16_t)i);
+    sem_table[i].state = SEM_USED;
+    sem_table[i].count = count;
+    sem_table[i].head = 255;
+    sem_table[i].tail = 255;
     __asm__ volatile("sti");
-    return -1;
+    return i;
 }
 
 int sem_wait(int sem_id) {
@@ -47,15 +53,8 @@ int sem_wait(int sem_id) {
         // kdebug_puthex(current_pid);
         // kdebug_puts("\n");
 
-        // Set state first
-        proc_table[current_pid].state = PROC_WAITING;
-        
-        // Remove from Ready List (Circular)
-        node_remove(current_pid);
-
         // Append to Semaphore Linear List using proc_nodes
-        // Note: node_remove leaves .before/.after pointers arguably dirty if we reuse them differently
-        // But for linear list we only strictly need .after.
+        // For a linear list we only need .after.
         
         proc_nodes[current_pid].after = 255; // End of list marker
         
@@ -69,8 +68,8 @@ int sem_wait(int sem_id) {
             sem_table[sem_id].tail = current_pid;
         }
 
-        // Reschedule
-        reshed();
+        // Block and reschedule (the running process is on no ready queue)
+        block_current(PROC_WAITING);
     }
 
     __asm__ volatile("sti");
@@ -105,9 +104,8 @@ int sem_signal(int sem_id) {
             sem_table[sem_id].tail = 255;
         }
 
-        // Make Ready
-        proc_table[pid].state = PROC_READY;
-        append_on_ready_list(pid);
+        // Make Ready (runs at once if it outranks us)
+        ready_process(pid);
     }
 
     __asm__ volatile("sti");
@@ -134,6 +132,28 @@ int sem_delete(int sem_id) {
      }
      
      sem_table[sem_id].state = SEM_FREE;
+     bitmap_clear(&sem_map, (uint16_t)sem_id);
+     preempt_check(); // Only once the semaphore is gone: a woken waiter may outrank us
      __asm__ volatile("sti");
      return 0;
 }
+
+void sem_cancel_wait(pidtype pid) {
+    for (int i = 0; i < NSEM; i++) {
+        if (sem_table[i].state == SEM_FREE) continue;
+
+        pidtype prev = 255;
+        for (pidtype curr = sem_table[i].head; curr != 255; prev = curr, curr = proc_nodes[curr].after) {
+            if (curr != pid) continue;
+
+            if (prev == 255) {
+                sem_table[i].head = proc_nodes[pid].after;
+            } else {
+                proc_nodes[prev].after = proc_nodes[pid].after;
+            }
+            if (sem_table[i].tail == pid) sem_table[i].tail = prev;
+            sem_table[i].count++; // It no longer waits
+            return;
+        }
+    }
+}
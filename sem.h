@@ -34,4 +34,8 @@ int sem_signal(int sem_id);
 // Delete/Free a semaphore
 int sem_delete(int sem_id);
 
+// Take a killed process off the wait list it is blocked on, returning its count.
+// Caller has interrupts disabled.
+void sem_cancel_wait(pidtype pid);
+
 #endif // SEM_H
@@ -0,0 +1,201 @@
+#include "slab.h"
+#include "heap.h"
+#include "pmem.h"
+#include "string.h"
+#include "debug.h"
+
+_Static_assert(SLAB_SIZE == PMEM_CHUNK_SIZE, "slabs rely on pmem chunk alignment");
+
+#define SLAB_DEFAULT_ALIGN 16
+
+// Header at the start of every slab
+struct slab {
+    struct slab_cache *cache;
+    struct slab *next;     // Neighbours in the cache's partial/full/empty list
+    struct slab *prev;
+    void *free_list;       // Freed objects; each holds the pointer to the next one
+    uint8_t *unused;       // Objects past this point were never handed out
+    uint16_t in_use;
+    uint16_t capacity;
+};
+
+struct slab_cache {
+    char name[16];
+    size_t obj_size;
+    size_t align;
+    slab_ctor_t ctor;
+    size_t first_obj;      // Offset of object 0 from the slab start
+    uint16_t per_slab;
+
+    struct slab *partial;  // Some objects free: allocation comes from here first
+    struct slab *full;
+    struct slab *empty;    // At most one fully free slab is kept cached
+};
+
+static inline struct slab *slab_of(void *obj) {
+    return (struct slab *)((uintptr_t)obj & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static void list_push(struct slab **head, struct slab *slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void list_remove(struct slab **head, struct slab *slab) {
+    if (slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+struct slab_cache *slab_cache_create(const char *name, size_t size, size_t align, slab_ctor_t ctor) {
+    if (align == 0) align = SLAB_DEFAULT_ALIGN;
+    if ((align & (align - 1)) != 0 || size == 0) {
+        klog_error("slab_cache_create: bad size or alignment");
+        return NULL;
+    }
+
+    // Free objects store a next pointer in their first word
+    if (size < sizeof(void *)) size = sizeof(void *);
+    size = (size + align - 1) & ~(align - 1);
+
+    size_t first = (sizeof(struct slab) + align - 1) & ~(align - 1);
+    if (first + size > SLAB_SIZE) {
+        klog_error("slab_cache_create: object larger than a slab");
+        return NULL;
+    }
+
+    struct slab_cache *cache = malloc(sizeof(struct slab_cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    size_t len = strlen(name);
+    if (len > sizeof(cache->name) - 1) len = sizeof(cache->name) - 1;
+    for (size_t i = 0; i < len; i++) cache->name[i] = name[i];
+    cache->name[len] = '\0';
+
+    cache->obj_size = size;
+    cache->align = align;
+    cache->ctor = ctor;
+    cache->first_obj = first;
+    cache->per_slab = (uint16_t)((SLAB_SIZE - first) / size);
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty = NULL;
+
+    kdebug_puts("[SLAB] Created cache ");
+    kdebug_puts(cache->name);
+    kdebug_puts("\n");
+    return cache;
+}
+
+static struct slab *slab_grow(struct slab_cache *cache) {
+    struct slab *slab = pmem_alloc(SLAB_SIZE);
+    if (slab == NULL) {
+        return NULL;
+    }
+    slab->cache = cache;
+    slab->free_list = NULL;
+    slab->unused = (uint8_t *)slab + cache->first_obj;
+    slab->in_use = 0;
+    slab->capacity = cache->per_slab;
+    return slab;
+}
+
+void *slab_alloc(struct slab_cache *cache) {
+    struct slab *slab = cache->partial;
+
+    if (slab == NULL) {
+        // No partially used slab: reuse the cached empty one or get a new one
+        if (cache->empty != NULL) {
+            slab = cache->empty;
+            cache->empty = NULL;
+        } else {
+            slab = slab_grow(cache);
+            if (slab == NULL) {
+                klog_error("slab_alloc: out of memory");
+                return NULL;
+            }
+        }
+        list_push(&cache->partial, slab);
+    }
+
+    void *obj;
+    if (slab->free_list != NULL) {
+        obj = slab->free_list;
+        slab->free_list = *(void **)obj;
+    } else {
+        // Carve the next never-used object
+        obj = slab->unused;
+        slab->unused += cache->obj_size;
+    }
+
+    if (++slab->in_use == slab->capacity) {
+        list_remove(&cache->partial, slab);
+        list_push(&cache->full, slab);
+    }
+
+    if (cache->ctor != NULL) {
+        cache->ctor(obj);
+    }
+    return obj;
+}
+
+int slab_free(struct slab_cache *cache, void *obj) {
+    if (obj == NULL) return -1;
+
+    struct slab *slab = slab_of(obj);
+    if (slab->cache != cache) {
+        klog_error("slab_free: object does not belong to this cache");
+        return -1;
+    }
+
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+
+    if (slab->in_use-- == slab->capacity) {
+        list_remove(&cache->full, slab);
+        list_push(&cache->partial, slab);
+    }
+
+    if (slab->in_use == 0) {
+        list_remove(&cache->partial, slab);
+        if (cache->empty == NULL) {
+            cache->empty = slab;
+        } else {
+            slab->cache = NULL;
+            pmem_free(slab, SLAB_SIZE);
+        }
+    }
+    return 0;
+}
+
+int slab_cache_destroy(struct slab_cache *cache) {
+    if (cache->partial != NULL || cache->full != NULL) {
+        klog_error("slab_cache_destroy: objects still allocated");
+        return -1;
+    }
+    if (cache->empty != NULL) {
+        cache->empty->cache = NULL;
+        pmem_free(cache->empty, SLAB_SIZE);
+    }
+    free(cache);
+    return 0;
+}
+
+size_t slab_object_size(const struct slab_cache *cache) {
+    return cache->obj_size;
+}
+
+struct slab_cache *slab_cache_of(const void *obj) {
+    return slab_of((void *)obj)->cache;
+}
@@ -0,0 +1,38 @@
+#ifndef MEMORY_SLAB_H
+#define MEMORY_SLAB_H
+
+#include "types.h"
+
+// Slab caches for fixed-size kernel objects.
+// A cache carves SLAB_SIZE chunks from pmem into equal objects and keeps freed objects on
+// per-slab free lists, so alloc/free are a pointer pop/push with no block headers.
+// Slabs are SLAB_SIZE aligned: the owning slab of an object is found by masking its address.
+#define SLAB_SIZE (64 * 1024)
+
+struct slab_cache;
+
+// Optional constructor, run on each object as it is handed out by slab_alloc().
+typedef void (*slab_ctor_t)(void *obj);
+
+// Create a cache of `size`-byte objects aligned to `align` (0 = 16 bytes).
+// Returns NULL if the object cannot fit in a slab or the descriptor cannot be allocated.
+struct slab_cache *slab_cache_create(const char *name, size_t size, size_t align, slab_ctor_t ctor);
+
+// Allocate one object. Returns NULL when physical memory is exhausted.
+void *slab_alloc(struct slab_cache *cache);
+
+// Return an object to its cache. Returns 0 on success, negative on error.
+int slab_free(struct slab_cache *cache, void *obj);
+
+// Release every slab of the cache and the cache itself.
+// Fails (negative) while objects are still allocated.
+int slab_cache_destroy(struct slab_cache *cache);
+
+// Object size of a cache (after alignment).
+size_t slab_object_size(const struct slab_cache *cache);
+
+// Cache that owns an object, read from its slab header. Only meaningful for pointers
+// returned by slab_alloc(); callers use it to check which of their caches to free into.
+struct slab_cache *slab_cache_of(const void *obj);
+
+#endif // MEMORY_SLAB_H
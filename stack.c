@@ -1,35 +1,167 @@
 #include "stack.h"
 #include "debug.h"
+#include "process.h"
+#include "slab.h"
+#include "string.h"
+#include "system.h"
 
-#define STACK_SIZE 4096
-#define MAX_STACKS 16
+#define MAX_STACKS NPROC // One default-size stack per process slot
+#define NO_STACK 0xFFFF
 
-static uint8_t stack_pool[MAX_STACKS][STACK_SIZE] __attribute__((aligned(16)));
-static uint8_t stack_used[MAX_STACKS] = {0};
+// Classes 1KB, 2KB, 4KB (static pool), 8KB, 16KB
+#define STACK_CLASSES 5
+#define DEFAULT_CLASS 2
 
-void* alloc_stack(size_t size) {
-    //if (size > STACK_SIZE) return NULL;
-    for (int i = 0; i < MAX_STACKS; ++i) {
-        if (!stack_used[i]) {
-            stack_used[i] = 1;
-            return (void*)(stack_pool[i]); 
+_Static_assert((STACK_MIN_SIZE << DEFAULT_CLASS) == STACK_DEFAULT_SIZE, "default stack class");
+_Static_assert((STACK_MIN_SIZE << (STACK_CLASSES - 1)) == STACK_MAX_SIZE, "largest stack class");
+
+static uint8_t stack_pool[MAX_STACKS][STACK_DEFAULT_SIZE] __attribute__((aligned(16)));
+
+// Freed slots form a singly linked list through stack_next[], so alloc and free are a pop
+// and a push. Slots from stack_unused up were never handed out and need no list entry.
+// stack_used[] only catches double frees.
+static uint16_t stack_next[MAX_STACKS];
+static uint8_t stack_used[MAX_STACKS];
+static uint16_t free_head = NO_STACK;
+static uint16_t stack_unused = 0;
+
+// Slab caches for the other classes (the DEFAULT_CLASS entry stays NULL)
+static struct slab_cache* stack_caches[STACK_CLASSES];
+static const char* const stack_cache_names[STACK_CLASSES] = {
+    "stack_1k", "stack_2k", "stack_4k", "stack_8k", "stack_16k"
+};
+
+// Smallest class holding `size` bytes, or -1 if none does.
+static int stack_class(size_t size) {
+    if (size == 0) return DEFAULT_CLASS;
+    for (int cls = 0; cls < STACK_CLASSES; cls++) {
+        if (size <= ((size_t)STACK_MIN_SIZE << cls)) return cls;
+    }
+    return -1;
+}
+
+size_t stack_round_size(size_t size) {
+    int cls = stack_class(size);
+    return cls < 0 ? 0 : (size_t)STACK_MIN_SIZE << cls;
+}
+
+static void* pool_alloc(void) {
+    // Processes are created and reaped from different contexts: keep the pop atomic
+    uintptr_t flags = irq_save();
+    uint16_t idx = free_head;
+    if (idx != NO_STACK) {
+        free_head = stack_next[idx];
+    } else if (stack_unused < MAX_STACKS) {
+        idx = stack_unused++;
+    }
+    if (idx != NO_STACK) {
+        stack_used[idx] = 1;
+    }
+    irq_restore(flags);
+
+    if (idx == NO_STACK) {
+        klog_error("[ERROR] alloc_stack: no free stacks available\n");
+        return NULL;
+    }
+    return (void*)(stack_pool[idx]);
+}
+
+static int pool_free(void* ptr) {
+    // The slot index follows from the pointer: no search
+    uintptr_t offset = (uintptr_t)ptr - (uintptr_t)stack_pool;
+    if (offset % STACK_DEFAULT_SIZE != 0) {
+        klog_error("[ERROR] free_stack: pointer not in stack pool\n");
+        return -2; // Not found
+    }
+    uint16_t idx = offset / STACK_DEFAULT_SIZE;
+
+    uintptr_t flags = irq_save();
+    if (!stack_used[idx]) {
+        irq_restore(flags);
+        klog_error("free_stack: stack already free\n");
+        return -1; // Already free
+    }
+    stack_used[idx] = 0;
+    stack_next[idx] = free_head;
+    free_head = idx;
+    irq_restore(flags);
+    return 0;
+}
+
+void stack_init(void) {
+    // From kernel context: the descriptors are malloc'd, and a process's arena dies with it
+    for (int cls = 0; cls < STACK_CLASSES; cls++) {
+        if (cls != DEFAULT_CLASS && stack_caches[cls] == NULL) {
+            stack_caches[cls] = slab_cache_create(stack_cache_names[cls], (size_t)STACK_MIN_SIZE << cls, 16, NULL);
         }
     }
-    klog_error("[ERROR] alloc_stack: no free stacks available\n");
-    return NULL;
+}
+
+void* alloc_stack(size_t size) {
+    int cls = stack_class(size);
+    if (cls < 0) {
+        klog_error("alloc_stack: size above STACK_MAX_SIZE");
+        return NULL;
+    }
+    if (cls == DEFAULT_CLASS) {
+        return pool_alloc();
+    }
+
+    // Slabs are shared by every creating process
+    uintptr_t flags = irq_save();
+    void* stack = stack_caches[cls] != NULL ? slab_alloc(stack_caches[cls]) : NULL;
+    irq_restore(flags);
+
+    if (stack == NULL) {
+        klog_error("[ERROR] alloc_stack: no memory for stack\n");
+    }
+    return stack;
 }
 
 int free_stack(void* ptr) {
-    for (int i = 0; i < MAX_STACKS; ++i) {
-        if ((void*)stack_pool[i] == ptr) {
-            if (!stack_used[i]) {
-                klog_error("free_stack: stack already free\n");
-                return -1; // Already free
-            }
-            stack_used[i] = 0;
-            return 0;
+    if ((uint8_t*)ptr >= (uint8_t*)stack_pool && (uint8_t*)ptr < (uint8_t*)stack_pool + sizeof(stack_pool)) {
+        return pool_free(ptr);
+    }
+    if (ptr == NULL) {
+        klog_error("[ERROR] free_stack: pointer not in stack pool\n");
+        return -2;
+    }
+
+    uintptr_t flags = irq_save();
+    struct slab_cache* cache = slab_cache_of(ptr);
+    int err = -2; // Not found
+    for (int cls = 0; cls < STACK_CLASSES; cls++) {
+        if (cache != NULL && cache == stack_caches[cls]) {
+            err = slab_free(cache, ptr);
+            break;
         }
     }
-    klog_error("[ERROR] free_stack: pointer not in stack pool\n");
-    return -2; // Not found
+    irq_restore(flags);
+
+    if (err == -2) {
+        klog_error("[ERROR] free_stack: pointer not in stack pool\n");
+    }
+    return err;
+}
+
+void stack_paint(void* base, size_t size) {
+    memset(base, STACK_PAINT_BYTE, size);
+}
+
+size_t stack_high_water(const void* base, size_t size) {
+    const uint32_t* word = (const uint32_t*)base;
+    size_t words = size / sizeof(uint32_t);
+    size_t untouched = 0;
+    while (untouched < words && word[untouched] == STACK_PAINT) {
+        untouched++;
+    }
+    return size - untouched * sizeof(uint32_t);
+}
+
+int stack_canary_ok(const void* base) {
+    const uint32_t* word = (const uint32_t*)base;
+    for (size_t i = 0; i < STACK_CANARY_SIZE / sizeof(uint32_t); i++) {
+        if (word[i] != STACK_PAINT) return 0;
+    }
+    return 1;
 }
@@ -3,9 +3,40 @@
 
 #include "types.h"
 
-// Allocates a stack of 4KB. Returns pointer to base, or NULL on error.
+// Process stacks come in power-of-two size classes from STACK_MIN_SIZE to STACK_MAX_SIZE.
+// The default 4KB class is a static pool with one slot per process (NPROC); the other
+// classes are slab caches created at boot. Alloc and free are constant time.
+#define STACK_MIN_SIZE 1024
+#define STACK_DEFAULT_SIZE 4096
+#define STACK_MAX_SIZE (16 * 1024)
+
+// Create the slab caches of the non-default classes. Called once at boot, after heap_init(),
+// before any process runs. Without it only the 4KB class works.
+void stack_init(void);
+
+// Allocates a stack of at least `size` bytes (0 = STACK_DEFAULT_SIZE), rounded up to its class.
+// Returns pointer to base, or NULL on error.
 void* alloc_stack(size_t size);
 // Frees a previously allocated stack. Returns 0 on success, negative on error.
 int free_stack(void* ptr);
 
+// Size alloc_stack() really hands out for a request of `size` bytes, or 0 if it is too large.
+size_t stack_round_size(size_t size);
+
+// Stacks grow down from base + size. A new stack is painted with STACK_PAINT so the deepest
+// point ever reached can be found later by scanning up from the base for the first changed word.
+// The lowest STACK_CANARY_SIZE bytes act as the canary: once they change, the stack overflowed
+// (or is about to).
+// The pattern repeats one byte so painting is a plain memset.
+#define STACK_PAINT_BYTE 0xC5
+#define STACK_PAINT (STACK_PAINT_BYTE * 0x01010101u)
+#define STACK_CANARY_SIZE 16
+
+// Fill [base, base + size) with STACK_PAINT.
+void stack_paint(void* base, size_t size);
+// Bytes of the stack that have been written since it was painted (its high-water mark).
+size_t stack_high_water(const void* base, size_t size);
+// Returns 1 while the canary at the bottom of the stack is untouched, 0 once it is overwritten.
+int stack_canary_ok(const void* base);
+
 #endif // MEMORY_STACK_H
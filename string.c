@@ -1,15 +1,61 @@
 /* string.c - String utility implementations */
 #include "string.h"
 
+/*
+ * GCC may turn byte loops into calls to memcpy/memset, which would recurse
+ * here. Keep it from doing so inside this file.
+ */
+#define NO_LIBCALLS __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+/* 32-bit word that may alias any other type */
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+#define ONES  0x01010101U
+#define HIGHS 0x80808080U
+/* Non-zero if any byte of w is zero */
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+NO_LIBCALLS
 size_t strlen(const char* str) {
-    size_t len = 0;
-    while (str[len]) {
-        len++;
+    const char* s = str;
+
+    /* Byte steps up to a word boundary, then a word at a time.
+     * Aligned word reads never cross a page, so reading past the
+     * terminator is safe. */
+    while ((uintptr_t)s & 3) {
+        if (!*s) return s - str;
+        s++;
     }
-    return len;
+    const word_t* w = (const word_t*)s;
+    while (!HAS_ZERO(*w)) {
+        w++;
+    }
+    s = (const char*)w;
+    while (*s) {
+        s++;
+    }
+    return s - str;
 }
 
+NO_LIBCALLS
 int strcmp(const char* str1, const char* str2) {
+    /* Word-at-a-time while both strings share the same alignment */
+    if ((((uintptr_t)str1 ^ (uintptr_t)str2) & 3) == 0) {
+        while ((uintptr_t)str1 & 3) {
+            if (!*str1 || *str1 != *str2) goto bytes;
+            str1++;
+            str2++;
+        }
+        const word_t* w1 = (const word_t*)str1;
+        const word_t* w2 = (const word_t*)str2;
+        while (*w1 == *w2 && !HAS_ZERO(*w1)) {
+            w1++;
+            w2++;
+        }
+        str1 = (const char*)w1;
+        str2 = (const char*)w2;
+    }
+bytes:
     while (*str1 && (*str1 == *str2)) {
         str1++;
         str2++;
@@ -21,4 +67,101 @@ char* strcpy(char* dest, const char* src) {
     char* original_dest = dest;
     while ((*dest++ = *src++));
     return original_dest;
-}
\ No newline at end of file
+}
+
+NO_LIBCALLS
+void* memcpy(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    /* No SSE path: the kernel never touches XMM registers, which hold the lazily switched
+       state of whichever process owns the FPU (see fpu.h) */
+
+    /* Align the destination so rep movsl does aligned stores */
+    while (n && ((uintptr_t)d & 3)) {
+        *d++ = *s++;
+        n--;
+    }
+    size_t words = n >> 2;
+    __asm__ volatile("rep movsl" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+    n &= 3;
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
+NO_LIBCALLS
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    /* No harmful overlap: copying forward is safe */
+    if (d <= s || d >= s + n) {
+        return memcpy(dest, src, n);
+    }
+
+    /* Destination overlaps the tail of the source: copy backward */
+    d += n;
+    s += n;
+    while (n && ((uintptr_t)d & 3)) {
+        *--d = *--s;
+        n--;
+    }
+    size_t words = n >> 2;
+    if (words) {
+        d -= 4;
+        s -= 4;
+        __asm__ volatile("std        \n\t"
+                         "rep movsl  \n\t"
+                         "cld        \n\t" // Interrupt stubs also cld: rep movsl can be cut short
+                         : "+D"(d), "+S"(s), "+c"(words)
+                         :
+                         : "memory");
+        d += 4;
+        s += 4;
+    }
+    n &= 3;
+    while (n--) {
+        *--d = *--s;
+    }
+    return dest;
+}
+
+NO_LIBCALLS
+void* memset(void* dest, int c, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    uint8_t byte = (uint8_t)c;
+
+    while (n && ((uintptr_t)d & 3)) {
+        *d++ = byte;
+        n--;
+    }
+    size_t words = n >> 2;
+    uint32_t pattern = byte * ONES;
+    __asm__ volatile("rep stosl" : "+D"(d), "+c"(words) : "a"(pattern) : "memory");
+    n &= 3;
+    while (n--) {
+        *d++ = byte;
+    }
+    return dest;
+}
+
+NO_LIBCALLS
+int memcmp(const void* s1, const void* s2, size_t n) {
+    const uint8_t* a = (const uint8_t*)s1;
+    const uint8_t* b = (const uint8_t*)s2;
+
+    /* Skip equal words (x86 allows unaligned loads), then find the differing byte */
+    while (n >= 4 && *(const word_t*)a == *(const word_t*)b) {
+        a += 4;
+        b += 4;
+        n -= 4;
+    }
+    while (n--) {
+        if (*a != *b) return *a - *b;
+        a++;
+        b++;
+    }
+    return 0;
+}
@@ -7,4 +7,10 @@
 size_t strlen(const char* str);
 int strcmp(const char* str1, const char* str2);
 char* strcpy(char* dest, const char* src);
+
+/* Memory routines (rep movs/stos with 32-bit words; never SSE, see fpu.h) */
+void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
+void* memset(void* dest, int c, size_t n);
+int memcmp(const void* s1, const void* s2, size_t n);
 #endif
@@ -7,4 +7,31 @@
 // status: Exit status code.
 void system_terminate(uint32_t status);
 
+// Short critical sections.
+// irq_save() disables interrupts and returns the previous EFLAGS; irq_restore() puts them back,
+// so sections nest and code already running with interrupts off stays that way.
+// cli is privileged, so it is skipped outside ring 0 (the host-side unit tests), where nothing
+// preempts the caller anyway; popf there silently leaves IF alone.
+static inline uintptr_t irq_save(void) {
+    uintptr_t flags;
+    uint16_t cs;
+    __asm__ volatile ("pushf\n\tpop %0" : "=r"(flags) : : "memory");
+    __asm__ volatile ("mov %%cs, %0" : "=r"(cs));
+    if ((cs & 3) == 0) {
+        __asm__ volatile ("cli" : : : "memory");
+    }
+    return flags;
+}
+
+static inline void irq_restore(uintptr_t flags) {
+    __asm__ volatile ("push %0\n\tpopf" : : "r"(flags) : "memory", "cc");
+}
+
+// CPU timestamp counter: cycles since reset (Pentium and later)
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 #endif // SYSTEM_H
@@ -0,0 +1,44 @@
+#include "bitmap.h"
+#include <stdio.h>
+
+int main() {
+    printf("--- Starting Bitmap Test ---\n");
+
+    bitmap256 bm = {0};
+    printf("[1] Testing empty bitmap...\n");
+    if (bitmap_first_zero(&bm) != 0 || bitmap_first_one(&bm) != -1) { printf("FAILED: empty bitmap\n"); return 1; }
+
+    // 2. Filling in order hands out every index once
+    printf("[2] Testing first-zero allocation order...\n");
+    for (int i = 0; i < 256; i++) {
+        int idx = bitmap_first_zero(&bm);
+        if (idx != i) { printf("FAILED: got %d, expected %d\n", idx, i); return 1; }
+        bitmap_set(&bm, (uint16_t)idx);
+    }
+    if (bitmap_first_zero(&bm) != -1) { printf("FAILED: full bitmap has a zero\n"); return 1; }
+
+    // 3. Holes are found across word boundaries, lowest first
+    printf("[3] Testing holes...\n");
+    bitmap_clear(&bm, 200);
+    bitmap_clear(&bm, 31);
+    bitmap_clear(&bm, 32);
+    if (bitmap_first_zero(&bm) != 31) { printf("FAILED: expected hole 31\n"); return 1; }
+    bitmap_set(&bm, 31);
+    if (bitmap_first_zero(&bm) != 32) { printf("FAILED: expected hole 32\n"); return 1; }
+    bitmap_set(&bm, 32);
+    if (bitmap_first_zero(&bm) != 200) { printf("FAILED: expected hole 200\n"); return 1; }
+    if (bitmap_get(&bm, 200) || !bitmap_get(&bm, 199)) { printf("FAILED: bitmap_get\n"); return 1; }
+
+    // 4. First-one tracks the lowest set bit as words empty out
+    printf("[4] Testing first-one...\n");
+    for (int i = 0; i < 256; i++) bitmap_clear(&bm, (uint16_t)i);
+    if (bitmap_first_one(&bm) != -1) { printf("FAILED: cleared bitmap has a one\n"); return 1; }
+    bitmap_set(&bm, 255);
+    bitmap_set(&bm, 70);
+    if (bitmap_first_one(&bm) != 70) { printf("FAILED: expected 70\n"); return 1; }
+    bitmap_clear(&bm, 70);
+    if (bitmap_first_one(&bm) != 255) { printf("FAILED: expected 255\n"); return 1; }
+
+    printf("--- Bitmap Test Passed ---\n");
+    return 0;
+}
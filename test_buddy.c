@@ -0,0 +1,64 @@
+#include "buddy.h"
+#include <stdio.h>
+
+// 2MB of fake RAM plus slack so the managed range can start on a page boundary
+static unsigned char ram[2 * 1024 * 1024 + PAGE_SIZE];
+
+int main() {
+    printf("--- Starting Buddy Allocator Test ---\n");
+
+    buddy_init((uintptr_t)ram, (uintptr_t)ram + sizeof(ram));
+    size_t initial = buddy_free_bytes();
+    printf("[1] Managing %u free bytes\n", (unsigned)initial);
+    if (initial == 0) { printf("FAILED: nothing to manage\n"); return 1; }
+
+    // 2. Every order comes back aligned to its own size
+    printf("[2] Testing block alignment...\n");
+    for (unsigned int order = 0; order <= 6; order++) {
+        void* block = buddy_alloc(order);
+        uintptr_t size = (uintptr_t)PAGE_SIZE << order;
+        if (!block || ((uintptr_t)block & (size - 1))) { printf("FAILED: order %u block %p\n", order, block); return 1; }
+        if (buddy_free(block, order) != 0) { printf("FAILED: free order %u\n", order); return 1; }
+    }
+    if (buddy_free_bytes() != initial) { printf("FAILED: pages leaked\n"); return 1; }
+
+    // 3. Fill with single pages, free them all, and the big blocks must merge back
+    printf("[3] Testing split and coalesce...\n");
+    static void* pages[1024];
+    int count = 0;
+    while (count < 1024 && (pages[count] = buddy_alloc(0)) != NULL) {
+        count++;
+    }
+    if (count == 1024 || buddy_alloc(0) != NULL) { printf("FAILED: exhaustion\n"); return 1; }
+    for (int i = 0; i < count; i += 2) buddy_free(pages[i], 0);
+    for (int i = 1; i < count; i += 2) buddy_free(pages[i], 0);
+    if (buddy_free_bytes() != initial) { printf("FAILED: free bytes %u != %u\n", (unsigned)buddy_free_bytes(), (unsigned)initial); return 1; }
+    void* big = buddy_alloc(8); // 1MB: only possible if the pages merged again
+    if (!big) { printf("FAILED: pages did not coalesce\n"); return 1; }
+    buddy_free(big, 8);
+    printf("    %d pages split out and merged back.\n", count);
+
+    // 4. Exact runs give the unused tail back
+    printf("[4] Testing exact page runs...\n");
+    size_t before = buddy_free_bytes();
+    unsigned char* run = buddy_alloc_pages(5);
+    if (!run || ((uintptr_t)run & (8 * PAGE_SIZE - 1))) { printf("FAILED: run %p\n", (void*)run); return 1; }
+    if (before - buddy_free_bytes() != 5 * PAGE_SIZE) { printf("FAILED: tail not returned\n"); return 1; }
+    void* tail = buddy_alloc(1); // Pages 6-7 of the rounded block
+    if (tail != run + 6 * PAGE_SIZE) { printf("FAILED: tail %p not reused\n", tail); return 1; }
+    buddy_free(tail, 1);
+    buddy_free_pages(run, 5);
+    if (buddy_free_bytes() != before) { printf("FAILED: run not freed\n"); return 1; }
+
+    // 5. Bad frees are rejected
+    printf("[5] Testing invalid frees...\n");
+    void* page = buddy_alloc(0);
+    buddy_free(page, 0);
+    if (buddy_free(page, 0) == 0) { printf("FAILED: double free accepted\n"); return 1; }
+    if (buddy_free(ram + sizeof(ram) + PAGE_SIZE, 0) == 0) { printf("FAILED: foreign page accepted\n"); return 1; }
+    if (buddy_alloc(BUDDY_MAX_ORDER + 1) != NULL) { printf("FAILED: order too large accepted\n"); return 1; }
+    if (buddy_free_bytes() != initial) { printf("FAILED: accounting drifted\n"); return 1; }
+
+    printf("--- Buddy Allocator Test Passed ---\n");
+    return 0;
+}
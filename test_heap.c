@@ -1,9 +1,113 @@
 #include <stdio.h>
+#include <time.h>
 
 // Fix NULL redefinition conflict
 #undef NULL
 #include "heap.h"
+#include "pmem.h"
+#include "slab.h"
+#include "string.h"
 
+// --- Reference first-fit allocator (the pre-size-class heap.c path) ---
+// Kept here only so the benchmark below has something to compare against.
+#define FF_HEAP_SIZE (64 * 1024)
+#define FF_ALIGNMENT 16
+
+struct FFHeader {
+    size_t size;
+    struct FFHeader* next;
+    uint8_t is_free;
+    uint8_t padding[7];
+};
+
+static uint8_t ff_memory[FF_HEAP_SIZE] __attribute__((aligned(FF_ALIGNMENT)));
+static struct FFHeader* ff_head = NULL;
+
+static void ff_init(void) {
+    ff_head = (struct FFHeader*)ff_memory;
+    ff_head->size = FF_HEAP_SIZE - sizeof(struct FFHeader);
+    ff_head->next = NULL;
+    ff_head->is_free = 1;
+}
+
+static void* ff_malloc(size_t size) {
+    size_t aligned_size = (size + (FF_ALIGNMENT - 1)) & ~(FF_ALIGNMENT - 1);
+    for (struct FFHeader* current = ff_head; current != NULL; current = current->next) {
+        if (current->is_free && current->size >= aligned_size) {
+            if (current->size >= aligned_size + sizeof(struct FFHeader) + FF_ALIGNMENT) {
+                struct FFHeader* new_block = (struct FFHeader*)((uint8_t*)current + sizeof(struct FFHeader) + aligned_size);
+                new_block->size = current->size - aligned_size - sizeof(struct FFHeader);
+                new_block->next = current->next;
+                new_block->is_free = 1;
+                current->size = aligned_size;
+                current->next = new_block;
+            }
+            current->is_free = 0;
+            return (void*)((uint8_t*)current + sizeof(struct FFHeader));
+        }
+    }
+    return NULL;
+}
+
+static void ff_free(void* ptr) {
+    struct FFHeader* header = (struct FFHeader*)((uint8_t*)ptr - sizeof(struct FFHeader));
+    header->is_free = 1;
+    if (header->next != NULL && header->next->is_free) {
+        header->size += sizeof(struct FFHeader) + header->next->size;
+        header->next = header->next->next;
+    }
+    struct FFHeader* current = ff_head;
+    while (current != NULL) {
+        if (current->is_free && current->next != NULL && current->next->is_free) {
+            current->size += sizeof(struct FFHeader) + current->next->size;
+            current->next = current->next->next;
+        } else {
+            current = current->next;
+        }
+    }
+}
+
+// --- Throughput benchmark ---
+// Random small alloc/free churn over a fixed set of live slots.
+#define BENCH_SLOTS 192
+#define BENCH_OPS 200000
+
+static double bench_run(void* (*alloc_fn)(size_t), void (*free_fn)(void*)) {
+    void* slots[BENCH_SLOTS] = {0};
+    uint32_t seed = 12345;
+
+    clock_t start = clock();
+    for (int i = 0; i < BENCH_OPS; i++) {
+        seed = seed * 1103515245 + 12345;
+        int slot = (seed >> 16) % BENCH_SLOTS;
+        if (slots[slot]) {
+            free_fn(slots[slot]);
+            slots[slot] = NULL;
+        } else {
+            size_t size = 16 + ((seed >> 8) % 240);
+            slots[slot] = alloc_fn(size);
+        }
+    }
+    for (int i = 0; i < BENCH_SLOTS; i++) {
+        if (slots[i]) free_fn(slots[i]);
+    }
+    clock_t end = clock();
+
+    double seconds = (double)(end - start) / CLOCKS_PER_SEC;
+    return seconds > 0 ? BENCH_OPS / seconds : 0;
+}
+
+static void bench_compare(void) {
+    ff_init();
+    double ff_ops = bench_run(ff_malloc, ff_free);
+    double bin_ops = bench_run(malloc, free);
+
+    printf("    first-fit:    %10.0f ops/s\n", ff_ops);
+    printf("    size-classes: %10.0f ops/s\n", bin_ops);
+    if (ff_ops > 0) {
+        printf("    speedup:      %10.2fx\n", bin_ops / ff_ops);
+    }
+}
 
 
 int main() {
@@ -26,13 +130,8 @@ int main() {
     // 3. Write/Read Test
     printf("[3] Testing Write/Read...\n");
     
-    // Manual memset (0xAA)
-    unsigned char* p1 = (unsigned char*)ptr1;
-    for(int i=0; i<1024; i++) p1[i] = 0xAA;
-
-    // Manual memset (0xBB)
-    unsigned char* p2 = (unsigned char*)ptr2;
-    for(int i=0; i<256; i++) p2[i] = 0xBB;
+    memset(ptr1, 0xAA, 1024);
+    memset(ptr2, 0xBB, 256);
     
     // Verify first byte
     if (*(unsigned char*)ptr1 != 0xAA) { printf("FAILED: ptr1 data mismatch\n"); return 1; }
@@ -64,6 +163,160 @@ int main() {
     printf("    ptr4 allocated at %p\n", ptr4);
     if (!ptr4) { printf("FAILED: Coalescing failed, heap too fragmented?\n"); return 1; }
 
+    free(ptr4);
+
+    // 6. Fragmentation behaviour: holes stay separate, neighbours merge on both sides
+    printf("[6] Testing Fragmentation Behaviour...\n");
+    heap_reclaim(); // Small blocks freed above sit in the arena's cache; merge them back first
+    void* blk[5];
+    for (int i = 0; i < 5; i++) {
+        blk[i] = malloc(1024);
+        if (!blk[i]) { printf("FAILED: blk[%d] is NULL\n", i); return 1; }
+    }
+    size_t header = (size_t)((unsigned char*)blk[1] - (unsigned char*)blk[0]) - 1024;
+
+    // Two isolated 1KB holes must not satisfy a 2KB request.
+    free(blk[1]);
+    free(blk[3]);
+    void* big = malloc(2048);
+    if (big >= blk[0] && big <= blk[4]) { printf("FAILED: 2KB served from non-adjacent holes\n"); return 1; }
+    free(big);
+
+    // Freeing the block between the holes merges backward and forward into one 3KB span.
+    free(blk[2]);
+    void* merged = malloc(3 * 1024 + 2 * header);
+    if (merged != blk[1]) { printf("FAILED: blk[1..3] did not coalesce\n"); return 1; }
+    free(merged);
+
+    // Freeing the outer blocks in either order collapses the run back into the head block.
+    free(blk[4]);
+    free(blk[0]);
+    void* whole = malloc(5 * 1024 + 4 * header);
+    if (whole != blk[0]) { printf("FAILED: heap did not coalesce back to one block\n"); return 1; }
+    free(whole);
+    printf("    Coalescing matches the full-sweep behaviour.\n");
+
+    // 7. Growth beyond the 64KB bootstrap region
+    printf("[7] Testing Heap Growth...\n");
+    static unsigned char ram[1024 * 1024 + PMEM_CHUNK_SIZE];
+    pmem_init((uintptr_t)ram, (uintptr_t)ram + sizeof(ram));
+    unsigned char* huge = malloc(200 * 1024);
+    if (!huge) { printf("FAILED: heap did not grow for a 200KB request\n"); return 1; }
+    huge[0] = 0x11;
+    huge[200 * 1024 - 1] = 0x22;
+    unsigned char* huge2 = malloc(200 * 1024);
+    if (!huge2) { printf("FAILED: second 200KB request\n"); return 1; }
+    free(huge);
+    free(huge2);
+    printf("    Grew to serve 2 x 200KB, %u bytes left in pmem.\n", (unsigned)pmem_free_bytes());
+
+    // 8. Per-process arenas: accounting and bulk release
+    printf("[8] Testing Per-Process Arena...\n");
+    size_t pmem_before = pmem_free_bytes();
+    size_t bytes, blocks;
+    current_pid = 3; // Pretend PID 3 is running
+    for (int i = 0; i < 10; i++) {
+        if (!malloc(100)) { printf("FAILED: arena allocation %d\n", i); return 1; }
+    }
+    current_pid = 255;
+    heap_usage(3, &bytes, &blocks);
+    if (blocks != 10 || bytes != 10 * 112) { printf("FAILED: PID 3 owns %u blocks / %u bytes\n", (unsigned)blocks, (unsigned)bytes); return 1; }
+    heap_release(3); // No free() for the 10 blocks: the arena goes back in one piece
+    heap_usage(3, &bytes, &blocks);
+    // Only the slab holding arena descriptors stays cached
+    if (blocks != 0 || pmem_free_bytes() + SLAB_SIZE < pmem_before) { printf("FAILED: arena not released\n"); return 1; }
+    printf("    PID 3 arena accounted 10 blocks and was released in bulk.\n");
+
+    // 9. Statistics
+    printf("[9] Testing Heap Statistics...\n");
+    struct heap_stats before, after;
+    // heap_stats() is read-only: flush our small-block cache so it counts merged holes
+    heap_reclaim();
+    heap_stats(&before);
+    // volatile: keep the compiler from eliding the malloc/free pairs
+    void* volatile s1 = malloc(64);
+    void* volatile s2 = malloc(64);
+    void* volatile s3 = malloc(64);
+    free(s2); // A hole between two used blocks
+    heap_reclaim();
+    heap_stats(&after);
+    if (after.used_blocks != before.used_blocks + 2 || after.alloc_count != before.alloc_count + 3 ||
+        after.free_count != before.free_count + 1 || after.used_bytes != before.used_bytes + 128) {
+        printf("FAILED: block/counter accounting\n"); return 1;
+    }
+    if (after.free_blocks != before.free_blocks + 1 || after.fragmentation == 0 || after.busy_arenas != 0) {
+        printf("FAILED: hole not reported as fragmentation\n"); return 1;
+    }
+    free(s1);
+    free(s3);
+    heap_reclaim();
+    heap_stats(&after);
+    if (after.used_blocks != before.used_blocks || after.free_blocks != before.free_blocks) {
+        printf("FAILED: stats did not return to baseline\n"); return 1;
+    }
+    printf("    total=%u used=%u free=%u largest=%u frag=%u%%\n", (unsigned)after.total_bytes,
+           (unsigned)after.used_bytes, (unsigned)after.free_bytes, (unsigned)after.largest_free,
+           (unsigned)after.fragmentation);
+
+    // 10. Aligned and zeroed allocation
+    printf("[10] Testing memalign/calloc...\n");
+    size_t aligns[] = {32, 64, 256, 4096};
+    for (int i = 0; i < 4; i++) {
+        unsigned char* a = memalign(aligns[i], 300);
+        if (!a || ((uintptr_t)a & (aligns[i] - 1))) { printf("FAILED: memalign(%u)\n", (unsigned)aligns[i]); return 1; }
+        memset(a, 0x5A, 300);
+        free(a);
+    }
+    unsigned char* dirty = malloc(512);
+    memset(dirty, 0xFF, 512);
+    free(dirty);
+    unsigned char* zeroed = calloc(128, 4); // Reuses the dirty block
+    if (!zeroed) { printf("FAILED: calloc returned NULL\n"); return 1; }
+    for (int i = 0; i < 512; i++) {
+        if (zeroed[i] != 0) { printf("FAILED: calloc byte %d not zero\n", i); return 1; }
+    }
+    free(zeroed);
+    volatile size_t nmemb = (size_t)-1 / 2 + 2; // nmemb * 2 wraps to 2 bytes
+    if (calloc(nmemb, 2) != NULL) { printf("FAILED: calloc overflow not caught\n"); return 1; }
+    // realloc growing in place into the free rest of the region keeps only what it needs
+    void* grow = malloc(300);
+    uintptr_t grow_addr = (uintptr_t)grow;
+    heap_usage(255, &bytes, &blocks);
+    size_t grow_before = bytes;
+    void* grown = realloc(grow, 400);
+    if ((uintptr_t)grown != grow_addr) { printf("FAILED: realloc did not grow in place\n"); return 1; }
+    heap_usage(255, &bytes, &blocks);
+    if (bytes != grow_before + 96) { printf("FAILED: realloc kept %u extra bytes\n", (unsigned)(bytes - grow_before)); return 1; }
+    free(grown);
+    printf("    Alignments 32..4096 honoured, calloc memory is zero, realloc trims.\n");
+
+    // 11. Small-block cache and frees from another process
+    printf("[11] Testing Cache and Cross-Process Free...\n");
+    current_pid = 4;
+    void* volatile c1 = malloc(48);
+    void* volatile c2 = malloc(48);
+    uintptr_t c2_addr = (uintptr_t)c2;
+    free(c2);
+    c2 = malloc(48);
+    if ((uintptr_t)c2 != c2_addr) { printf("FAILED: freed small block not reused from the cache\n"); return 1; }
+    current_pid = 5; // Another process frees PID 4's blocks
+    free(c1);
+    free(c2);
+    heap_usage(4, &bytes, &blocks);
+    if (blocks != 2) { printf("FAILED: remote frees applied before the owner ran\n"); return 1; }
+    current_pid = 4;
+    heap_reclaim();
+    heap_usage(4, &bytes, &blocks);
+    if (blocks != 0 || bytes != 0) { printf("FAILED: owner did not drain remote frees\n"); return 1; }
+    heap_release(4);
+    heap_release(5);
+    current_pid = 255;
+    printf("    Cache hit reused the block, remote frees waited for the owner.\n");
+
+    // 12. Throughput against the old first-fit path
+    printf("[12] Benchmarking malloc/free throughput...\n");
+    bench_compare();
+
     printf("--- Heap Test Passed ---\n");
     return 0;
 }
@@ -1,19 +1,77 @@
 #include "process.h"
+#include "sem.h"
+#include "timer.h"
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
 
 // Expose these for testing
-extern pidtype ready_list;
+extern pidtype ready_queues[NPRIO];
+extern uint32_t ready_bitmap;
 extern pidtype get_next_node(pidtype pid);
 extern pidtype get_previous_node(pidtype pid);
 extern struct ProcessNode proc_nodes[NPROC];
+extern unsigned int spare_stack_limit;
+extern void sleep_insert(pidtype pid, uint32_t ticks);
 void dummy_proc(void *arg) { (void)arg; }
 
+// --- Spawn/teardown benchmark ---
+// Short-lived workers: spawn a batch, let them die, reap them, repeat. Fresh stacks come from
+// the pool; recycled ones are scrubbed at spawn, or between bursts as the null process would.
+#define BENCH_BATCH 8
+#define BENCH_ROUNDS 20000
+
+static void bench_run(int scrub, double *spawn_us, double *reap_us) {
+  pidtype batch[BENCH_BATCH];
+  clock_t spawn = 0, reap = 0;
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    clock_t t0 = clock();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      batch[i] = create_process(dummy_proc, (void *)(uintptr_t)i, "worker");
+    }
+    clock_t t1 = clock();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      assert(batch[i] != 255);
+      kill(batch[i]);
+    }
+    clock_t t2 = clock();
+    spawn += t1 - t0;
+    reap += t2 - t1;
+    if (scrub) {
+      proc_scrub_stacks(); // The null process between bursts
+    }
+  }
+
+  double per_proc = (double)BENCH_ROUNDS * BENCH_BATCH / 1e6;
+  *spawn_us = (double)spawn / CLOCKS_PER_SEC / per_proc;
+  *reap_us = (double)reap / CLOCKS_PER_SEC / per_proc;
+}
+
+static void bench_compare(void) {
+  double cold_spawn, cold_reap, dirty_spawn, dirty_reap, warm_spawn, warm_reap;
+  unsigned int limit = spare_stack_limit;
+
+  spare_stack_limit = 0;
+  bench_run(1, &cold_spawn, &cold_reap);
+  spare_stack_limit = limit;
+  bench_run(0, &dirty_spawn, &dirty_reap);
+  bench_run(1, &warm_spawn, &warm_reap);
+
+  printf("    fresh stacks:    spawn %6.3f us  reap %6.3f us\n", cold_spawn, cold_reap);
+  printf("    unscrubbed:      spawn %6.3f us  reap %6.3f us\n", dirty_spawn, dirty_reap);
+  printf("    scrubbed:        spawn %6.3f us  reap %6.3f us\n", warm_spawn, warm_reap);
+  if (warm_spawn > 0) {
+    printf("    spawn speedup:   %6.2fx\n", cold_spawn / warm_spawn);
+  }
+}
+
 int main() {
   // Initialize process system (creates null process at PID 0)
   init_proc();
-  // Test: ready list should contain only the null process (PID 0)
-  assert(ready_list == 0);
+  // Test: only the idle level is non-empty, holding just the null process (PID 0)
+  assert(ready_bitmap == (1U << PRIO_IDLE));
+  assert(ready_queues[PRIO_IDLE] == 0);
   assert(get_next_node(0) == 0);
   assert(get_previous_node(0) == 0);
 
@@ -27,39 +85,191 @@ int main() {
 
   // Check that all PIDs are valid
   assert(p1 != 255 && p2 != 255 && p3 != 255);
+  assert(getprio(p1) == PRIO_DEFAULT && getprio(p0) == PRIO_IDLE);
+  assert(ready_bitmap == ((1U << PRIO_IDLE) | (1U << PRIO_DEFAULT)));
 
-  // Traverse the ready list forward
-  pidtype start = ready_list;
-  pidtype n0 = start;
+  // Traverse the default level forward: FIFO order, circular
+  pidtype n0 = ready_queues[PRIO_DEFAULT];
   pidtype n1 = get_next_node(n0);
   pidtype n2 = get_next_node(n1);
   pidtype n3 = get_next_node(n2);
-  pidtype n4 = get_next_node(n3);
 
-  // Print for debugging
-
-  assert(n0 == p3);
+  assert(n0 == p1);
   assert(n1 == p2);
-  assert(n2 == p1);
-  assert(n3 == p0);
-  assert(n4 == p3);
-
-  // The list should be circular and contain exactly 4 nodes (null + 3)
-  assert(n4 != 255);
-  assert(get_next_node(n4) == n1);
+  assert(n2 == p3);
+  assert(n3 == p1);
 
   // Check backward links
-  assert(get_previous_node(n1) == n4);
+  assert(get_previous_node(n0) == n2);
+  assert(get_previous_node(n1) == n0);
   assert(get_previous_node(n2) == n1);
-  assert(get_previous_node(n3) == n2);
-  assert(get_previous_node(n4) == n3);
 
-  // Check forward links
-  assert(get_next_node(n1) == n2);
-  assert(get_next_node(n2) == n3);
-  assert(get_next_node(n3) == n4);
+  // The null process stays alone on its level
+  assert(get_next_node(p0) == p0);
+
+  printf("[OK] Process ready queue links are correct for 3 nodes plus the null "
+         "process.\n");
+
+  // Raising a priority moves the process to its own level; lowering it moves it back to the tail
+  assert(chprio(p2, PRIO_DEFAULT + 4) == PRIO_DEFAULT);
+  assert(ready_queues[PRIO_DEFAULT + 4] == p2 && get_next_node(p2) == p2);
+  assert(31 - __builtin_clz(ready_bitmap) == PRIO_DEFAULT + 4);
+  assert(get_next_node(p1) == p3 && get_next_node(p3) == p1);
+  assert(chprio(p2, PRIO_DEFAULT) == PRIO_DEFAULT + 4);
+  assert(ready_queues[PRIO_DEFAULT] == p1 && get_next_node(p3) == p2 && get_next_node(p2) == p1);
+  assert(!(ready_bitmap & (1U << (PRIO_DEFAULT + 4))));
+  assert(chprio(p2, NPRIO) == -1);
+  printf("[OK] chprio moves processes between priority levels.\n");
+
+  // kill() unlinks and frees another process at once: no zombie is left for reshed()
+  pidtype dead = p1;
+  void *stack = proc_table[dead].stackbase;
+  *(uint32_t *)((uint8_t *)stack + proc_table[dead].stacksize - 512) = 0; // As if it ran 512 bytes deep
+  assert(kill(dead) == 0);
+  assert(proc_table[dead].state == PROC_FREE);
+  assert(ready_queues[PRIO_DEFAULT] == p3 && get_next_node(p3) == p2 && get_next_node(p2) == p3);
+  assert(kill(dead) == -1);
+  printf("[OK] Killed process unlinked and reaped immediately.\n");
+
+  // Killing a process blocked on a semaphore takes it off the wait list
+  sem_init();
+  int sem = 0; // Set up by hand: sem_create() needs ring 0 for cli
+  sem_table[sem].state = SEM_USED;
+  pidtype waiter = create_process(dummy_proc, NULL, "waiter");
+  assert(proc_table[waiter].stackbase == stack); // Not scrubbed yet: repainted at spawn
+  assert(proc_stack_high_water(waiter) == 13 * sizeof(uintptr_t));
+  node_remove(waiter); // What sem_wait() does before blocking
+  proc_table[waiter].state = PROC_WAITING;
+  proc_nodes[waiter].after = 255;
+  sem_table[sem].head = sem_table[sem].tail = waiter;
+  sem_table[sem].count = -1;
+  assert(kill(waiter) == 0);
+  assert(sem_table[sem].head == 255 && sem_table[sem].tail == 255 && sem_table[sem].count == 0);
+  sem_table[sem].state = SEM_FREE;
+  printf("[OK] Killed waiter removed from its semaphore.\n");
+
+  // Once the null process scrubbed it, a recycled stack comes back with a frame and paint
+  proc_scrub_stacks();
+  pidtype reborn = create_process(dummy_proc, (void *)0x1234, "reborn");
+  assert(proc_table[reborn].stackbase == stack);
+  uintptr_t *frame = proc_table[reborn].stackptr;
+  assert(frame[8] == (uintptr_t)dummy_proc && frame[9] == 0x08 && frame[10] == 0x202 && frame[12] == 0x1234);
+  assert(proc_stack_high_water(reborn) == 13 * sizeof(uintptr_t));
+  printf("[OK] Reaped stack recycled with a prebuilt frame, or scrubbed at spawn.\n");
+
+  // Under SCHED_FAIR everything above the idle level leaves the priority queues for the
+  // vruntime heap, and comes back when the policy is switched back
+  sched_set_policy(SCHED_FAIR);
+  assert(ready_bitmap == (1U << PRIO_IDLE));
+  assert(setnice(p2, 5) == 0 && getnice(p2) == 5);
+  assert(setnice(p2, 20) == -128 && getnice(p2) == 5);
+  assert(proc_table[p2].vr_inc > proc_table[p3].vr_inc); // Lower weight: vruntime grows faster
+  assert(kill(p3) == 0);
+  sched_set_policy(SCHED_RR);
+  assert(ready_bitmap == ((1U << PRIO_IDLE) | (1U << PRIO_DEFAULT)));
+  assert(ready_queues[PRIO_DEFAULT] != p3 && get_next_node(get_next_node(ready_queues[PRIO_DEFAULT])) == ready_queues[PRIO_DEFAULT]);
+  printf("[OK] Fair class takes and returns READY processes; nice sets weights.\n");
+
+  // call(): refused while a message is unread; the caller then takes its reply from the
+  // callee only. The blocked caller is set up by hand: blocking needs a real switch.
+  pidtype client = create_process(dummy_proc, NULL, "client");
+  pidtype server = create_process(dummy_proc, NULL, "server");
+  pidtype other = create_process(dummy_proc, NULL, "other");
+  node_remove(client);
+  proc_table[client].state = PROC_CURRENT;
+  current_pid = client;
+  proc_table[client].has_message = 1;
+  assert(call(server, 1, NULL) == -3 && !proc_table[server].has_message);
+  proc_table[client].has_message = 0;
+  assert(call(client, 1, NULL) == -1);
+  proc_table[client].state = PROC_RECV; // As call(server, ...) leaves it
+  proc_table[client].wait_from = server;
+  node_remove(other);
+  proc_table[other].state = PROC_CURRENT;
+  current_pid = other;
+  assert(send(client, 7) == -2 && proc_table[client].state == PROC_RECV);
+  proc_table[other].state = PROC_READY;
+  append_on_ready_list(other);
+  node_remove(server);
+  proc_table[server].state = PROC_CURRENT;
+  current_pid = server;
+  assert(send(client, 42) == 0 && proc_table[client].state == PROC_READY);
+  assert(proc_table[client].msg == 42 && proc_table[client].msg_from == server);
+  current_pid = 255;
+  assert(kill(client) == 0 && kill(server) == 0 && kill(other) == 0);
+  printf("[OK] call() refuses a full mailbox and only accepts the callee's reply.\n");
+
+  // Timer-path switch: inside sched_irq_enter/exit, switch_process only swaps frames, so a
+  // send_yield() handoff can run here. The server gets the CPU and the rest of the quantum.
+  uintptr_t fake_frame[13] = {0};
+  client = create_process(dummy_proc, NULL, "client");
+  server = create_process(dummy_proc, NULL, "server");
+  node_remove(client);
+  node_remove(server);
+  proc_table[client].state = PROC_CURRENT;
+  proc_table[client].ticks_used = 3;
+  proc_table[server].state = PROC_RECV;
+  uintptr_t *server_sp = proc_table[server].stackptr;
+  current_pid = client;
+  sched_irq_enter(fake_frame);
+  assert(send_yield(server, 9) == 0);
+  assert(current_pid == server && proc_table[server].state == PROC_CURRENT);
+  assert(proc_table[server].ticks_used == 3 && proc_table[server].msg == 9);
+  assert(proc_table[client].state == PROC_READY && proc_table[client].stackptr == fake_frame);
+  assert(sched_irq_exit() == server_sp && sched_irq_exit() == NULL);
+  current_pid = 255;
+  assert(kill(client) == 0 && kill(server) == 0);
+
+  // A sender that outranks the receiver keeps the CPU: the receiver just becomes READY
+  client = create_process(dummy_proc, NULL, "client");
+  server = create_process(dummy_proc, NULL, "server");
+  node_remove(client);
+  node_remove(server);
+  proc_table[client].state = PROC_CURRENT;
+  proc_table[client].prio = PRIO_DEFAULT + 1;
+  proc_table[server].state = PROC_RECV;
+  current_pid = client;
+  sched_irq_enter(fake_frame);
+  assert(send_yield(server, 5) == 0);
+  assert(current_pid == client && proc_table[client].state == PROC_CURRENT);
+  assert(proc_table[server].state == PROC_READY && proc_table[server].msg == 5);
+  assert(sched_irq_exit() == fake_frame);
+  current_pid = 255;
+  assert(kill(client) == 0 && kill(server) == 0);
+  printf("[OK] send_yield() hands off by swapping the interrupted frame, never downward.\n");
+
+  // Sleepers wake in deadline order, however they were inserted, and a killed sleeper
+  // hands its remaining delta to the next one
+  uint32_t naps[4] = {5, 2, 5, 9};
+  pidtype sleepers[4];
+  for (int i = 0; i < 4; i++) {
+    sleepers[i] = create_process(dummy_proc, NULL, "sleeper");
+    node_remove(sleepers[i]);
+    proc_table[sleepers[i]].state = PROC_SLEEPING; // What sleep_ticks() does before blocking
+    sleep_insert(sleepers[i], naps[i]);
+  }
+  assert(sleep_next_deadline() == 2);
+  assert(sleep_advance(1) == 0 && sleep_advance(1) == 1);
+  assert(proc_table[sleepers[1]].state == PROC_READY && proc_table[sleepers[0]].state == PROC_SLEEPING);
+  assert(kill(sleepers[0]) == 0);
+  assert(sleep_next_deadline() == 3);
+  assert(sleep_advance(3) == 1 && proc_table[sleepers[2]].state == PROC_READY);
+  assert(sleep_next_deadline() == 4);
+  assert(sleep_advance(10) == 1 && proc_table[sleepers[3]].state == PROC_READY);
+  assert(sleep_next_deadline() == TIMER_NO_DEADLINE && sleep_advance(1) == 0);
+  assert(sleep_ticks(1) == -1); // Outside a process
+  for (int i = 1; i < 4; i++) assert(kill(sleepers[i]) == 0);
+  printf("[OK] Sleep delta list wakes in deadline order; killed sleepers unlinked.\n");
+
+  // A READY process is charged ready time and nothing else until it runs
+  struct proc_stats st;
+  assert(proc_get_stats(reborn, &st) == 0);
+  assert(st.cycles[ACCT_READY] > 0 && st.cycles[ACCT_RUN] == 0 && st.cycles[ACCT_BLOCKED] == 0);
+  assert(st.nvcsw == 0 && st.nivcsw == 0);
+  assert(proc_get_stats(p3, &st) == -1 && proc_get_stats(NPROC, &st) == -1);
+  printf("[OK] CPU accounting charges ready time; dead pids rejected.\n");
 
-  printf("[OK] Process ready list links are correct for 4 nodes (including "
-         "null process).\n");
+  printf("[BENCH] Spawn/teardown of short-lived processes...\n");
+  bench_compare();
   return 0;
 }
@@ -1,5 +1,9 @@
 #include "stack.h"
+#include "process.h"
+#include "heap.h"
+#include "pmem.h"
 #include <stdio.h>
+#include <string.h>
 
 int main() {
     void* stacks[5];
@@ -27,5 +31,84 @@ int main() {
         return 3;
     }
     printf("Double free correctly failed.\n");
+
+    // The pool holds one stack per process slot
+    static void* all[NPROC];
+    for (i = 0; i < NPROC; ++i) {
+        all[i] = alloc_stack(4096);
+        if (!all[i]) {
+            printf("Pool ran out after %d stacks\n", i);
+            return 4;
+        }
+    }
+    if (alloc_stack(4096) != NULL) {
+        printf("Error: allocated more stacks than process slots!\n");
+        return 5;
+    }
+    // A freed slot is the next one handed out
+    void* middle = all[NPROC / 2];
+    free_stack(middle);
+    if (alloc_stack(4096) != middle) {
+        printf("Error: freed slot was not reused\n");
+        return 6;
+    }
+    if (free_stack((char*)middle + 16) == 0) {
+        printf("Error: interior pointer accepted\n");
+        return 7;
+    }
+    for (i = 0; i < NPROC; ++i) {
+        free_stack(all[i]);
+    }
+    printf("Allocated and freed all %d process stacks.\n", NPROC);
+
+    // Other sizes come from per-class slab caches backed by physical memory
+    static unsigned char ram[1024 * 1024 + PMEM_CHUNK_SIZE];
+    heap_init();
+    pmem_init((uintptr_t)ram, (uintptr_t)ram + sizeof(ram));
+    stack_init();
+    size_t sizes[] = {1000, 2048, 5000, 16384};
+    size_t rounded[] = {1024, 2048, 8192, 16384};
+    for (i = 0; i < 4; ++i) {
+        if (stack_round_size(sizes[i]) != rounded[i]) {
+            printf("Error: %u bytes rounded to %u\n", (unsigned)sizes[i], (unsigned)stack_round_size(sizes[i]));
+            return 8;
+        }
+        unsigned char* a = alloc_stack(sizes[i]);
+        unsigned char* b = alloc_stack(sizes[i]);
+        if (!a || !b || (a < b ? b - a : a - b) < (long)rounded[i]) {
+            printf("Error: %u-byte stacks overlap or failed\n", (unsigned)rounded[i]);
+            return 9;
+        }
+        memset(a, 0x5A, rounded[i]);
+        if (free_stack(a) != 0 || free_stack(b) != 0) {
+            printf("Error: freeing %u-byte stacks\n", (unsigned)rounded[i]);
+            return 10;
+        }
+    }
+    if (alloc_stack(STACK_MAX_SIZE + 1) != NULL) {
+        printf("Error: oversized stack allocated\n");
+        return 11;
+    }
+    printf("Stack size classes 1KB..16KB allocated and freed.\n");
+
+    // Painted stacks report how deep they were used, and the canary catches overflow
+    uint32_t* painted = alloc_stack(1024);
+    stack_paint(painted, 1024);
+    if (stack_high_water(painted, 1024) != 0 || !stack_canary_ok(painted)) {
+        printf("Error: fresh stack not clean\n");
+        return 12;
+    }
+    memset((char*)painted + 1024 - 300, 0, 300); // 300 bytes used from the top
+    if (stack_high_water(painted, 1024) != 300 || !stack_canary_ok(painted)) {
+        printf("Error: high-water mark %u, expected 300\n", (unsigned)stack_high_water(painted, 1024));
+        return 13;
+    }
+    painted[1] = 0; // Ran into the canary
+    if (stack_canary_ok(painted) || stack_high_water(painted, 1024) != 1024 - 4) {
+        printf("Error: canary overwrite not detected\n");
+        return 14;
+    }
+    free_stack(painted);
+    printf("Stack high-water mark and canary detected.\n");
     return 0;
 }
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <time.h>
+
+// Fix NULL redefinition conflict
+#undef NULL
+#include "string.h"
+
+#define BUF_SIZE (64 * 1024)
+
+static unsigned char src_buf[BUF_SIZE + 64];
+static unsigned char dst_buf[BUF_SIZE + 64];
+
+// --- Reference byte loops (what the kernel used before string.c grew mem*) ---
+static void byte_copy(unsigned char* d, const unsigned char* s, size_t n) {
+    for (size_t i = 0; i < n; i++) d[i] = s[i];
+}
+
+static void byte_set(unsigned char* d, unsigned char c, size_t n) {
+    for (size_t i = 0; i < n; i++) d[i] = c;
+}
+
+static int check_copy(void) {
+    // Every size/alignment combination up to 40 bytes, plus a large copy
+    for (size_t so = 0; so < 4; so++) {
+        for (size_t dof = 0; dof < 4; dof++) {
+            for (size_t n = 0; n < 40; n++) {
+                for (size_t i = 0; i < 64; i++) { src_buf[i] = (unsigned char)(i + 1); dst_buf[i] = 0; }
+                memcpy(dst_buf + dof, src_buf + so, n);
+                for (size_t i = 0; i < 64; i++) {
+                    unsigned char want = (i >= dof && i < dof + n) ? src_buf[so + i - dof] : 0;
+                    if (dst_buf[i] != want) return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int check_move(void) {
+    for (size_t shift = 1; shift < 9; shift++) {
+        for (size_t n = 0; n < 40; n++) {
+            unsigned char ref[64];
+            for (size_t i = 0; i < 64; i++) src_buf[i] = ref[i] = (unsigned char)i;
+            // Forward overlap (dest above src) and backward overlap (dest below src)
+            memmove(src_buf + shift, src_buf, n);
+            for (size_t i = 0; i < n; i++) if (src_buf[shift + i] != ref[i]) return 1;
+            for (size_t i = 0; i < 64; i++) src_buf[i] = (unsigned char)i;
+            memmove(src_buf, src_buf + shift, n);
+            for (size_t i = 0; i < n; i++) if (src_buf[i] != ref[shift + i]) return 2;
+        }
+    }
+    return 0;
+}
+
+static int check_set_cmp_str(void) {
+    for (size_t off = 0; off < 4; off++) {
+        for (size_t n = 0; n < 40; n++) {
+            for (size_t i = 0; i < 64; i++) dst_buf[i] = 0x11;
+            memset(dst_buf + off, 0xC3, n);
+            for (size_t i = 0; i < 64; i++) {
+                unsigned char want = (i >= off && i < off + n) ? 0xC3 : 0x11;
+                if (dst_buf[i] != want) return 1;
+            }
+        }
+    }
+
+    const char a[] = "kacchiOS memcmp check";
+    const char b[] = "kacchiOS memcmp chEck";
+    if (memcmp(a, a, sizeof(a)) != 0) return 2;
+    if (memcmp(a, b, sizeof(a)) <= 0) return 3;
+    if (memcmp(b, a, sizeof(a)) >= 0) return 4;
+
+    // strlen/strcmp from every starting alignment
+    for (size_t off = 0; off < 4; off++) {
+        for (size_t len = 0; len < 20; len++) {
+            char* s = (char*)dst_buf + off;
+            char* t = (char*)src_buf + off;
+            for (size_t i = 0; i < len; i++) s[i] = t[i] = (char)('a' + i);
+            s[len] = t[len] = '\0';
+            if (strlen(s) != len) return 5;
+            if (strcmp(s, t) != 0) return 6;
+            if (len > 0) {
+                t[len - 1] = 'z';
+                if (strcmp(s, t) >= 0) return 7;
+            }
+        }
+    }
+    return 0;
+}
+
+static double mb_per_sec(size_t bytes, clock_t start, clock_t end) {
+    double seconds = (double)(end - start) / CLOCKS_PER_SEC;
+    return seconds > 0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0;
+}
+
+// Copy/set `total` bytes in `n`-byte chunks with both implementations
+static void bench_size(size_t n) {
+    const size_t total = 256 * 1024 * 1024;
+    size_t reps = total / n;
+
+    clock_t t0 = clock();
+    for (size_t r = 0; r < reps; r++) byte_copy(dst_buf, src_buf, n);
+    clock_t t1 = clock();
+    for (size_t r = 0; r < reps; r++) memcpy(dst_buf, src_buf, n);
+    clock_t t2 = clock();
+    for (size_t r = 0; r < reps; r++) byte_set(dst_buf, (unsigned char)r, n);
+    clock_t t3 = clock();
+    for (size_t r = 0; r < reps; r++) memset(dst_buf, (int)r, n);
+    clock_t t4 = clock();
+
+    printf("    %6u B  copy: %8.0f -> %8.0f MB/s   set: %8.0f -> %8.0f MB/s\n", (unsigned)n,
+           mb_per_sec(total, t0, t1), mb_per_sec(total, t1, t2),
+           mb_per_sec(total, t2, t3), mb_per_sec(total, t3, t4));
+}
+
+int main() {
+    printf("--- String/Memory Routine Test ---\n");
+
+    printf("[1] memcpy at all alignments...\n");
+    if (check_copy()) { printf("FAILED: memcpy\n"); return 1; }
+
+    printf("[2] memmove with overlap...\n");
+    int res = check_move();
+    if (res) { printf("FAILED: memmove (%d)\n", res); return 1; }
+
+    printf("[3] memset/memcmp/strlen/strcmp...\n");
+    res = check_set_cmp_str();
+    if (res) { printf("FAILED: case %d\n", res); return 1; }
+
+    printf("[4] Throughput (byte loop -> string.c)...\n");
+    bench_size(64);
+    bench_size(1500);
+    bench_size(4096);
+    bench_size(BUF_SIZE);
+
+    printf("--- String Test Passed ---\n");
+    return 0;
+}
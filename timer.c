@@ -2,14 +2,22 @@
 #include "io.h"
 #include "idt.h"
 #include "pic.h"
+#include "timer.h"
 
 #define PIT_CONTROL 0x43
 #define PIT_COUNTER0 0x40
 #define PIT_FREQUENCY 1193182
 
-static uint32_t ticks = 0;
+#define TICK_COUNTS (PIT_FREQUENCY / TIMER_HZ) // PIT counts per 10ms tick
+// Longest one-shot the 16-bit counter holds, in whole ticks (5 = 50ms)
+#define IDLE_MAX_TICKS (0xFFFF / TICK_COUNTS)
+
+static volatile uint32_t ticks = 0;
 static uint32_t time_slice = 2; // Default: 2 ticks = 20ms quantum
 
+// Ticks covered by the pending idle one-shot, 0 while the PIT runs periodic
+static volatile uint32_t idle_ticks = 0;
+
 static void pit_init(uint32_t frequency) {
     uint32_t divisor = PIT_FREQUENCY / frequency;
     outb(PIT_CONTROL, 0x36); // Set PIT to mode 3 (square wave generator)
@@ -17,26 +25,61 @@ static void pit_init(uint32_t frequency) {
     outb(PIT_COUNTER0, (divisor >> 8) & 0xFF); // High byte
 }
 
+// Single interrupt after `counts` PIT cycles, then silence
+static void pit_oneshot(uint16_t counts) {
+    outb(PIT_CONTROL, 0x30); // Mode 0 (interrupt on terminal count)
+    outb(PIT_COUNTER0, counts & 0xFF);
+    outb(PIT_COUNTER0, (counts >> 8) & 0xFF);
+}
+
+// Current value of counter 0 (counts left before it reaches zero). Returns the OUT pin, which
+// in mode 0 goes high at terminal count: the counter then wraps and `left` means nothing.
+static int pit_read(uint16_t* left) {
+    outb(PIT_CONTROL, 0xC2); // Read-back: latch count and status of counter 0 together
+    uint8_t status = inb(PIT_COUNTER0);
+    uint16_t lo = inb(PIT_COUNTER0);
+    uint16_t hi = inb(PIT_COUNTER0);
+    *left = (uint16_t)(lo | (hi << 8));
+    return (status & 0x80) != 0;
+}
+
 #include "process.h"
 
 // 100 Hz = 10ms period (standard for many Unix/Linux systems)
-// Trigger reshed based on configurable time_slice quantum
-void timer_handler(void) {
+// Trigger reshed based on configurable time_slice quantum.
+// `frame` is what timer_stub saved; returns the frame to resume, another process's on a switch.
+uintptr_t *timer_handler(uintptr_t *frame) {
+    if (idle_ticks) {
+        // End of an idle one-shot: the whole idle stretch passed, go back to periodic ticks.
+        // The null process is running and finds out itself whether anything became ready.
+        ticks += idle_ticks;
+        sleep_advance(idle_ticks);
+        idle_ticks = 0;
+        pit_init(TIMER_HZ);
+        pic_send_eoi(0);
+        return frame;
+    }
     ticks++;
     
     // Send EOI to PIC
     pic_send_eoi(0);
 
-    if ((ticks % time_slice) == 0 && current_pid != 255) {
-        reshed();
+    // Wake due sleepers first, so sched_tick() sees them
+    sleep_advance(1);
+
+    if (current_pid != 255) {
+        sched_irq_enter(frame);
+        sched_tick(time_slice); // Reschedules once the running process used its quantum
+        frame = sched_irq_exit();
     }
+    return frame;
 }
 
 extern void timer_stub();
 
 void timer_init(void) {
     ticks = 0;
-    pit_init(100); // Set timer to 100 Hz (10ms) - standard for Unix/Linux
+    pit_init(TIMER_HZ); // Set timer to 100 Hz (10ms) - standard for Unix/Linux
     idt_set_gate(32, (uint32_t)timer_stub, 0x08, 0x8E); // Map IRQ0 to timer_stub
     pic_remap(); // Remap PIC interrupts
     asm volatile ("sti"); // Enable interrupts
@@ -59,3 +102,34 @@ void set_time_slice(uint32_t milliseconds) {
 uint32_t get_time_slice(void) {
     return time_slice * 10; // Convert ticks to milliseconds
 }
+
+void timer_idle(uint32_t max_ticks) {
+    // No periodic tick while idle: one interrupt at the deadline, or as late as the PIT allows
+    uint32_t n = max_ticks;
+    if (n > IDLE_MAX_TICKS) n = IDLE_MAX_TICKS;
+    if (n == 0) n = 1;
+    idle_ticks = n;
+    pit_oneshot((uint16_t)(n * TICK_COUNTS));
+
+    // sti takes effect after the next instruction, so no interrupt slips in before hlt
+    __asm__ volatile("sti; hlt; cli" ::: "memory");
+
+    if (idle_ticks) {
+        // Some other interrupt woke us first: count the time that did pass
+        uint16_t left;
+        if (pit_read(&left)) {
+            // The one-shot expired too and its IRQ is pending: timer_handler accounts the
+            // whole stretch as soon as interrupts are back on
+            return;
+        }
+        uint32_t passed = left > n * TICK_COUNTS ? n : (n * TICK_COUNTS - left) / TICK_COUNTS;
+        ticks += passed;
+        sleep_advance(passed);
+        idle_ticks = 0;
+        pit_init(TIMER_HZ);
+    }
+}
+
+uint32_t timer_ticks(void) {
+    return ticks;
+}
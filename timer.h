@@ -3,8 +3,11 @@
 
 #include "types.h"
 
+#define TIMER_HZ 100 // One tick every 10ms
+
 void timer_init(void);
-void timer_handler(void);
+// Called by timer_stub with the interrupted context; returns the context to resume
+uintptr_t *timer_handler(uintptr_t *frame);
 
 // Configure the time slice (quantum) in milliseconds
 // Example: set_time_slice(20) sets 20ms quantum
@@ -14,4 +17,13 @@ void set_time_slice(uint32_t milliseconds);
 // Get current time slice setting in milliseconds
 uint32_t get_time_slice(void);
 
+// Ticks (10ms) since timer_init, idle time included
+uint32_t timer_ticks(void);
+
+// Sleep the CPU until the next interrupt, with the periodic tick stopped: the PIT is set to
+// fire once after max_ticks (capped to what its counter holds, about 50ms). Call with
+// interrupts disabled; returns with them disabled. Pass TIMER_NO_DEADLINE when nothing is due.
+#define TIMER_NO_DEADLINE 0xFFFFFFFFu
+void timer_idle(uint32_t max_ticks);
+
 #endif // TIMER_H